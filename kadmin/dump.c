@@ -44,12 +44,23 @@ dump(struct dump_options *opt, int argc, char **argv)
     FILE *f;
     struct hdb_print_entry_arg parg;
     HDB *db = NULL;
+    unsigned shard = 0, nshards = 1;
 
     if (!local_flag) {
 	krb5_warnx(context, "dump is only available in local (-l) mode");
 	return 0;
     }
 
+    if (opt->shard_string) {
+	char c;
+
+	if (sscanf(opt->shard_string, "%u/%u%c", &shard, &nshards, &c) != 2 ||
+	    nshards == 0 || shard >= nshards) {
+	    krb5_warnx(context, "bad shard: %s", opt->shard_string);
+	    return 0;
+	}
+    }
+
     db = _kadm5_s_get_db(kadm_handle);
 
     if (argc == 0)
@@ -76,8 +87,8 @@ dump(struct dump_options *opt, int argc, char **argv)
         krb5_errx(context, 1, "Supported dump formats: Heimdal and MIT");
     }
     parg.out = f;
-    hdb_foreach(context, db, opt->decrypt_flag ? HDB_F_DECRYPT : 0,
-		hdb_print_entry, &parg);
+    hdb_foreach_shard(context, db, opt->decrypt_flag ? HDB_F_DECRYPT : 0,
+		      shard, nshards, hdb_print_entry, &parg);
 
     db->hdb_close(context, db);
 out:
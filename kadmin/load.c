@@ -362,7 +362,7 @@ parse_extensions(char *str, HDB_extensions **e)
 static int
 doit(const char *filename, int mergep)
 {
-    krb5_error_code ret;
+    krb5_error_code ret, ret2;
     FILE *f;
     char s[8192]; /* XXX should fix this properly */
     char *p;
@@ -392,6 +392,13 @@ doit(const char *filename, int mergep)
 	fclose(f);
 	return 1;
     }
+    ret = hdb_begin_bulk(context, db);
+    if (ret) {
+	krb5_warn(context, ret, "hdb_begin_bulk");
+	db->hdb_close(context, db);
+	fclose(f);
+	return 1;
+    }
     line = 0;
     ret = 0;
     while(fgets(s, sizeof(s), f) != NULL) {
@@ -535,6 +542,13 @@ doit(const char *filename, int mergep)
 	    break;
 	}
     }
+    /* Keep what was stored before any failure, as a plain load would */
+    ret2 = hdb_end_bulk(context, db, 1);
+    if (ret2) {
+	krb5_warn(context, ret2, "hdb_end_bulk");
+	if (ret == 0)
+	    ret = ret2;
+    }
     db->hdb_close(context, db);
     fclose(f);
     return ret != 0;
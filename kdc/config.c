@@ -58,6 +58,9 @@ static int version_flag;
 /* Should we enable the HTTP hack? */
 int enable_http = -1;
 
+/* Keep TCP connections open for further requests */
+int tcp_keep_open;
+
 /* Log over requests to the KDC */
 const char *request_log;
 
@@ -254,6 +257,9 @@ configure(krb5_context context, int argc, char **argv, int *optidx)
 	enable_http = krb5_config_get_bool(context, NULL, "kdc",
 					   "enable-http", NULL);
 
+    tcp_keep_open = krb5_config_get_bool(context, NULL, "kdc",
+					 "tcp-keep-open", NULL);
+
     if(request_log == NULL)
 	request_log = krb5_config_get_string(context, NULL,
 					     "kdc",
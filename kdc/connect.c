@@ -750,6 +750,7 @@ handle_tcp(krb5_context context,
     unsigned char buf[1024];
     int n;
     int ret = 0;
+    int http = 0;
 
     if (d[idx].timeout == 0) {
 	add_new_tcp (context, config, d, idx, min_free);
@@ -763,10 +764,12 @@ handle_tcp(krb5_context context,
 		  ntohs(d[idx].port));
 	return;
     } else if (n == 0) {
-	krb5_warnx(context, "connection closed before end of data after %lu "
-		   "bytes from %s to %s/%d", (unsigned long)d[idx].len,
-		   d[idx].addr_string, descr_type(d + idx),
-		   ntohs(d[idx].port));
+	/* with tcp-keep-open, closing an idle connection is normal */
+	if (d[idx].len > 0)
+	    krb5_warnx(context, "connection closed before end of data after "
+		       "%lu bytes from %s to %s/%d", (unsigned long)d[idx].len,
+		       d[idx].addr_string, descr_type(d + idx),
+		       ntohs(d[idx].port));
 	clear_descr (d + idx);
 	return;
     }
@@ -785,6 +788,7 @@ handle_tcp(krb5_context context,
         /* remove the trailing \r\n\r\n so the string is NUL terminated */
         d[idx].buf[d[idx].len - 4] = '\0';
 
+	http = 1;
 	ret = handle_http_tcp (context, config, &d[idx]);
 	if (ret < 0)
 	    clear_descr (d + idx);
@@ -820,7 +824,12 @@ handle_tcp(krb5_context context,
     else if (ret == 1) {
 	do_request(context, config,
 		   d[idx].buf, d[idx].len, TRUE, &d[idx]);
-	clear_descr(d + idx);
+	if (tcp_keep_open && !http) {
+	    /* wait for the next request on this connection */
+	    d[idx].len = 0;
+	    d[idx].timeout = time(NULL) + TCP_TIMEOUT;
+	} else
+	    clear_descr(d + idx);
     }
 }
 
@@ -44,6 +44,7 @@ static int to_stdout;
 static int verbose_flag;
 static int encrypt_flag;
 static int decrypt_flag;
+static int batch_flag;
 static hdb_master_key mkey5;
 
 static char *source_type;
@@ -86,6 +87,82 @@ open_socket(krb5_context context, const char *hostname, const char *port)
     return -1;
 }
 
+static krb5_error_code
+send_message(krb5_context context, struct prop_data *pd, krb5_data *data)
+{
+    if(to_stdout)
+	return krb5_write_message(context, &pd->sock, data);
+    return krb5_write_priv_message(context, pd->auth_context,
+				   &pd->sock, data);
+}
+
+static krb5_error_code
+reset_batch(krb5_context context, struct prop_data *pd)
+{
+    krb5_storage_truncate(pd->batch, 0);
+    krb5_storage_seek(pd->batch, 0, SEEK_SET);
+    if (krb5_storage_write(pd->batch, HPROP_BATCH_MAGIC,
+			   HPROP_BATCH_MAGIC_LEN) != HPROP_BATCH_MAGIC_LEN)
+	return krb5_enomem(context);
+    return 0;
+}
+
+/*
+ * Send the entries collected in pd->batch, if any, as one message
+ * and start a new batch.
+ */
+static krb5_error_code
+flush_batch(krb5_context context, struct prop_data *pd)
+{
+    krb5_error_code ret;
+    krb5_data data;
+
+    if (pd->batch == NULL ||
+	krb5_storage_seek(pd->batch, 0, SEEK_CUR) <= (off_t)HPROP_BATCH_MAGIC_LEN)
+	return 0;
+
+    ret = krb5_storage_to_data(pd->batch, &data);
+    if (ret)
+	return ret;
+    ret = send_message(context, pd, &data);
+    krb5_data_free(&data);
+    if (ret)
+	return ret;
+    return reset_batch(context, pd);
+}
+
+static krb5_error_code
+start_batch(krb5_context context, struct prop_data *pd)
+{
+    krb5_error_code ret;
+
+    pd->batch = NULL;
+    if (!batch_flag)
+	return 0;
+    pd->batch = krb5_storage_emem();
+    if (pd->batch == NULL)
+	return krb5_enomem(context);
+    ret = reset_batch(context, pd);
+    if (ret) {
+	krb5_storage_free(pd->batch);
+	pd->batch = NULL;
+    }
+    return ret;
+}
+
+static krb5_error_code
+end_batch(krb5_context context, struct prop_data *pd)
+{
+    krb5_error_code ret;
+
+    if (pd->batch == NULL)
+	return 0;
+    ret = flush_batch(context, pd);
+    krb5_storage_free(pd->batch);
+    pd->batch = NULL;
+    return ret;
+}
+
 krb5_error_code
 v5_prop(krb5_context context, HDB *db, hdb_entry_ex *entry, void *appdata)
 {
@@ -114,11 +191,16 @@ v5_prop(krb5_context context, HDB *db, hdb_entry_ex *entry, void *appdata)
 	return ret;
     }
 
-    if(to_stdout)
-	ret = krb5_write_message(context, &pd->sock, &data);
-    else
-	ret = krb5_write_priv_message(context, pd->auth_context,
-				      &pd->sock, &data);
+    if (pd->batch) {
+	ret = krb5_store_data(pd->batch, data);
+	krb5_data_free(&data);
+	if (ret == 0 &&
+	    krb5_storage_seek(pd->batch, 0, SEEK_CUR) >= HPROP_BATCH_SIZE)
+	    ret = flush_batch(context, pd);
+	return ret;
+    }
+
+    ret = send_message(context, pd, &data);
     krb5_data_free(&data);
     return ret;
 }
@@ -137,6 +219,8 @@ struct getargs args[] = {
     { "decrypt",  'D',  arg_flag,   &decrypt_flag,   "decrypt keys", NULL },
     { "encrypt",  'E',  arg_flag,   &encrypt_flag,   "encrypt keys", NULL },
     { "stdout",	  'n',  arg_flag,   &to_stdout, "dump to stdout", NULL },
+    { "batch",	  0,	arg_flag,   &batch_flag,
+      "send several entries per message (needs a batch-aware hpropd)", NULL },
     { "verbose",  'v',	arg_flag, &verbose_flag, NULL, NULL },
     { "version",   0,	arg_flag, &version_flag, NULL, NULL },
     { "help",     'h',	arg_flag, &help_flag, NULL, NULL }
@@ -230,6 +314,12 @@ iterate (krb5_context context,
 {
     int ret;
 
+    ret = start_batch(context, pd);
+    if (ret) {
+	krb5_warn(context, ret, "start_batch");
+	return ret;
+    }
+
     switch(type) {
     case HPROP_MIT_DUMP:
 	ret = mit_prop_dump(pd, database_name);
@@ -244,6 +334,14 @@ iterate (krb5_context context,
     default:
 	krb5_errx(context, 1, "unknown prop type: %d", type);
     }
+    if (ret == 0) {
+	ret = end_batch(context, pd);
+	if (ret)
+	    krb5_warn(context, ret, "sending last batch");
+    } else if (pd->batch) {
+	krb5_storage_free(pd->batch);
+	pd->batch = NULL;
+    }
     return ret;
 }
 
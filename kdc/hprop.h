@@ -42,6 +42,7 @@ struct prop_data{
     krb5_context context;
     krb5_auth_context auth_context;
     int sock;
+    krb5_storage *batch;	/* entries not yet sent, or NULL */
 };
 
 #define HPROP_VERSION "hprop-0.0"
@@ -49,6 +50,16 @@ struct prop_data{
 #define HPROP_KEYTAB "HDBGET:"
 #define HPROP_PORT 754
 
+/*
+ * With --batch, hprop packs several entries into one message: the
+ * magic followed by each encoded entry prefixed with its length as a
+ * 32-bit big-endian integer.  An encoded entry always starts with a
+ * DER SEQUENCE tag, so hpropd can tell the two apart.
+ */
+#define HPROP_BATCH_MAGIC "HPB1"
+#define HPROP_BATCH_MAGIC_LEN (sizeof(HPROP_BATCH_MAGIC) - 1)
+#define HPROP_BATCH_SIZE (64 * 1024)
+
 #ifndef NEVERDATE
 #define NEVERDATE ((1U << 31) - 1)
 #endif
@@ -59,6 +59,39 @@ struct getargs args[] = {
 static int num_args = sizeof(args) / sizeof(args[0]);
 static char unparseable_name[] = "unparseable name";
 
+static void
+receive_entry(krb5_context context, HDB *db, krb5_data *data, int *nprincs)
+{
+    krb5_error_code ret;
+    hdb_entry_ex entry;
+
+    memset(&entry, 0, sizeof(entry));
+    ret = hdb_value2entry(context, data, &entry.entry);
+    if (ret)
+	krb5_err(context, 1, ret, "hdb_value2entry");
+    if (print_dump) {
+	struct hdb_print_entry_arg parg;
+
+	parg.out = stdout;
+	parg.fmt = HDB_DUMP_HEIMDAL;
+	hdb_print_entry(context, db, &entry, &parg);
+    } else {
+	ret = db->hdb_store(context, db, 0, &entry);
+	if (ret == HDB_ERR_EXISTS) {
+	    char *s;
+	    ret = krb5_unparse_name(context, entry.entry.principal, &s);
+	    if (ret)
+		s = strdup(unparseable_name);
+	    krb5_warnx(context, "Entry exists: %s", s);
+	    free(s);
+	} else if (ret)
+	    krb5_err(context, 1, ret, "db_store");
+	else
+	    (*nprincs)++;
+    }
+    hdb_free_entry(context, &entry);
+}
+
 static void
 usage(int ret)
 {
@@ -219,12 +252,15 @@ main(int argc, char **argv)
 	ret = db->hdb_open(context, db, O_RDWR | O_CREAT | O_TRUNC, 0600);
 	if (ret)
 	    krb5_err(context, 1, ret, "hdb_open(%s)", tmp_db);
+	/* Nothing is visible until the rename, so commit in batches */
+	ret = hdb_begin_bulk(context, db);
+	if (ret)
+	    krb5_err(context, 1, ret, "hdb_begin_bulk(%s)", tmp_db);
     }
 
     nprincs = 0;
     while (1){
 	krb5_data data;
-	hdb_entry_ex entry;
 
 	if (from_stdin) {
 	    ret = krb5_read_message(context, &sock, &data);
@@ -243,6 +279,9 @@ main(int argc, char **argv)
 		krb5_write_priv_message(context, ac, &sock, &data);
 	    }
 	    if (!print_dump) {
+		ret = hdb_end_bulk(context, db, 1);
+		if (ret)
+		    krb5_err(context, 1, ret, "hdb_end_bulk");
 		ret = db->hdb_close(context, db);
 		if (ret)
 		    krb5_err(context, 1, ret, "db_close");
@@ -252,32 +291,30 @@ main(int argc, char **argv)
 	    }
 	    break;
 	}
-	memset(&entry, 0, sizeof(entry));
-	ret = hdb_value2entry(context, &data, &entry.entry);
+	if (data.length > HPROP_BATCH_MAGIC_LEN &&
+	    memcmp(data.data, HPROP_BATCH_MAGIC, HPROP_BATCH_MAGIC_LEN) == 0) {
+	    unsigned char *p = (unsigned char *)data.data + HPROP_BATCH_MAGIC_LEN;
+	    size_t len = data.length - HPROP_BATCH_MAGIC_LEN;
+	    unsigned long elen;
+	    krb5_data value;
+
+	    while (len > 0) {
+		if (len < 4)
+		    krb5_errx(context, 1, "truncated batch");
+		_krb5_get_int(p, &elen, 4);
+		p += 4;
+		len -= 4;
+		if (elen > len)
+		    krb5_errx(context, 1, "truncated batch");
+		value.data = p;
+		value.length = elen;
+		receive_entry(context, db, &value, &nprincs);
+		p += elen;
+		len -= elen;
+	    }
+	} else
+	    receive_entry(context, db, &data, &nprincs);
 	krb5_data_free(&data);
-	if (ret)
-	    krb5_err(context, 1, ret, "hdb_value2entry");
-	if (print_dump) {
-            struct hdb_print_entry_arg parg;
-
-            parg.out = stdout;
-            parg.fmt = HDB_DUMP_HEIMDAL;
-	    hdb_print_entry(context, db, &entry, &parg);
-        } else {
-	    ret = db->hdb_store(context, db, 0, &entry);
-	    if (ret == HDB_ERR_EXISTS) {
-		char *s;
-		ret = krb5_unparse_name(context, entry.entry.principal, &s);
-		if (ret)
-		    s = strdup(unparseable_name);
-		krb5_warnx(context, "Entry exists: %s", s);
-		free(s);
-	    } else if (ret)
-		krb5_err(context, 1, ret, "db_store");
-	    else
-		nprincs++;
-	}
-	hdb_free_entry(context, &entry);
     }
     if (!print_dump)
 	krb5_log(context, fac, 0, "Received %d principals", nprincs);
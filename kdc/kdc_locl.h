@@ -98,6 +98,7 @@ extern const char *port_str;
 extern krb5_addresses explicit_addresses;
 
 extern int enable_http;
+extern int tcp_keep_open;
 
 #ifdef SUPPORT_DETACH
 
@@ -798,7 +798,7 @@ _kdc_encode_reply(krb5_context context,
     krb5_error_code ret;
     krb5_crypto crypto;
 
-    ASN1_MALLOC_ENCODE(EncTicketPart, buf, buf_size, et, &len, ret);
+    DER_MALLOC_ENCODE(EncTicketPart, buf, buf_size, et, &len, ret);
     if(ret) {
 	const char *msg = krb5_get_error_message(context, ret);
 	kdc_log(context, config, 0, "Failed to encode ticket: %s", msg);
@@ -847,8 +847,8 @@ _kdc_encode_reply(krb5_context context,
 	finished.crealm = et->crealm;
 	finished.cname = et->cname;
 
-	ASN1_MALLOC_ENCODE(Ticket, data.data, data.length,
-			   &rep->ticket, &len, ret);
+	DER_MALLOC_ENCODE(Ticket, data.data, data.length,
+			  &rep->ticket, &len, ret);
 	if (ret)
 	    return ret;
 	if (data.length != len)
@@ -896,9 +896,9 @@ _kdc_encode_reply(krb5_context context,
     }
 
     if(rep->msg_type == krb_as_rep && !config->encode_as_rep_as_tgs_rep)
-	ASN1_MALLOC_ENCODE(EncASRepPart, buf, buf_size, ek, &len, ret);
+	DER_MALLOC_ENCODE(EncASRepPart, buf, buf_size, ek, &len, ret);
     else
-	ASN1_MALLOC_ENCODE(EncTGSRepPart, buf, buf_size, ek, &len, ret);
+	DER_MALLOC_ENCODE(EncTGSRepPart, buf, buf_size, ek, &len, ret);
     if(ret) {
 	const char *msg = krb5_get_error_message(context, ret);
 	kdc_log(context, config, 0, "Failed to encode KDC-REP: %s", msg);
@@ -928,7 +928,7 @@ _kdc_encode_reply(krb5_context context,
 				   ckvno,
 				   &rep->enc_part);
 	free(buf);
-	ASN1_MALLOC_ENCODE(AS_REP, buf, buf_size, rep, &len, ret);
+	DER_MALLOC_ENCODE(AS_REP, buf, buf_size, rep, &len, ret);
     } else {
 	krb5_encrypt_EncryptedData(context,
 				   crypto,
@@ -938,7 +938,7 @@ _kdc_encode_reply(krb5_context context,
 				   ckvno,
 				   &rep->enc_part);
 	free(buf);
-	ASN1_MALLOC_ENCODE(TGS_REP, buf, buf_size, rep, &len, ret);
+	DER_MALLOC_ENCODE(TGS_REP, buf, buf_size, rep, &len, ret);
     }
     krb5_crypto_destroy(context, crypto);
     if(ret) {
@@ -2307,9 +2307,9 @@ _kdc_tkt_add_if_relevant_ad(krb5_context context,
 
 	ade.ad_type = KRB5_AUTHDATA_IF_RELEVANT;
 
-	ASN1_MALLOC_ENCODE(AuthorizationData,
-			   ade.ad_data.data, ade.ad_data.length,
-			   &ad, &size, ret);
+	DER_MALLOC_ENCODE(AuthorizationData,
+			  ade.ad_data.data, ade.ad_data.length,
+			  &ad, &size, ret);
 	free_AuthorizationData(&ad);
 	if (ret) {
 	    krb5_set_error_message(context, ret, "ASN.1 encode of "
@@ -520,28 +520,34 @@ _kdc_pk_rd_padata(krb5_context context,
 	goto out;
     }
 
-    ret = hx509_certs_init(context->hx509ctx,
-			   "MEMORY:trust-anchors",
-			   0, NULL, &trust_anchors);
-    if (ret) {
-	krb5_set_error_message(context, ret, "failed to create trust anchors");
-	goto out;
-    }
-
-    ret = hx509_certs_merge(context->hx509ctx, trust_anchors,
-			    kdc_identity->anchors);
-    if (ret) {
-	hx509_certs_free(&trust_anchors);
-	krb5_set_error_message(context, ret, "failed to create verify context");
-	goto out;
-    }
-
-    /* Add any registered certificates for this client as trust anchors */
+    /*
+     * Add any registered certificates for this client as trust
+     * anchors, otherwise use the (indexed) KDC anchors as they are
+     * instead of copying them for each request.
+     */
     ret = hdb_entry_get_pkinit_cert(&client->entry, &pc);
-    if (ret == 0 && pc != NULL) {
+    if (ret || pc == NULL || pc->len == 0) {
+	trust_anchors = hx509_certs_ref(kdc_identity->anchors);
+    } else {
 	hx509_cert cert;
 	unsigned int i;
 
+	ret = hx509_certs_init(context->hx509ctx,
+			       "MEMORY:trust-anchors",
+			       0, NULL, &trust_anchors);
+	if (ret) {
+	    krb5_set_error_message(context, ret, "failed to create trust anchors");
+	    goto out;
+	}
+
+	ret = hx509_certs_merge(context->hx509ctx, trust_anchors,
+				kdc_identity->anchors);
+	if (ret) {
+	    hx509_certs_free(&trust_anchors);
+	    krb5_set_error_message(context, ret, "failed to create verify context");
+	    goto out;
+	}
+
 	for (i = 0; i < pc->len; i++) {
 	    cert = hx509_cert_init_data(context->hx509ctx,
 					pc->val[i].cert.data,
@@ -2103,6 +2109,24 @@ krb5_kdc_pk_initialize(krb5_context context,
 				     NULL))
 	config->pkinit_allow_proxy_certs = 1;
 
+    {
+	int cache_size;
+
+	cache_size = krb5_config_get_int_default(context,
+						 NULL,
+						 0,
+						 "kdc",
+						 "pkinit_verify_cache_size",
+						 NULL);
+	if (cache_size > 0) {
+	    ret = hx509_context_set_verify_cache(context->hx509ctx,
+						 cache_size);
+	    if (ret)
+		krb5_warn(context, ret, "PKINIT: failed to enable "
+			  "certificate verify cache");
+	}
+    }
+
     file = krb5_config_get_string(context,
 				  NULL,
 				  "kdc",
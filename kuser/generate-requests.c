@@ -33,6 +33,10 @@
 
 #include "kuser_locl.h"
 
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
 static unsigned
 read_words (const char *filename, char ***ret_w)
 {
@@ -60,44 +64,405 @@ read_words (const char *filename, char ***ret_w)
     return n;
 }
 
+/*
+ * Request types, selected at random according to the --mix weights.
+ * AS requests use the word as client, TGS requests use it as the
+ * server and S4U2Self requests as the client to impersonate.  TGS and
+ * S4U2Self requests are made with the TGT in the credential cache.
+ */
+
+enum { REQ_AS = 0, REQ_TGS, REQ_S4U, REQ_MAX };
+
+static const char *req_names[REQ_MAX] = { "as", "tgs", "s4u" };
+
+/* latency histogram buckets are powers of two in microseconds */
+#define NBUCKETS	32
+#define NERRORS		32
+
+struct stats {
+    unsigned long requests[REQ_MAX];
+    unsigned long failed;
+    uint64_t total_usec;
+    uint64_t min_usec;
+    uint64_t max_usec;
+    unsigned long histogram[NBUCKETS];
+    struct {
+	krb5_error_code code;
+	unsigned long count;
+    } errors[NERRORS];
+    unsigned long other_errors;
+};
+
+static char *mix_str		= "as";
+static char *password_str	= "";
+static char *cache_str		= NULL;
+static int rate			= 0;
+static int processes		= 1;
+static int version_flag		= 0;
+static int help_flag		= 0;
+
+static unsigned mix[REQ_MAX];
+static unsigned mix_total;
+
+static void
+parse_mix(const char *str)
+{
+    char *s, *p, *w, *end, *last = NULL;
+    long weight;
+    int i;
+
+    s = estrdup(str);
+    for (p = strtok_r(s, ",", &last); p; p = strtok_r(NULL, ",", &last)) {
+	weight = 1;
+	w = strchr(p, ':');
+	if (w) {
+	    *w++ = '\0';
+	    weight = strtol(w, &end, 0);
+	    if (w == end || *end != '\0' || weight < 0 || weight > 1000)
+		errx(1, "bad weight in mix: %s", w);
+	}
+	for (i = 0; i < REQ_MAX; i++)
+	    if (strcasecmp(p, req_names[i]) == 0)
+		break;
+	if (i == REQ_MAX)
+	    errx(1, "unknown request type in mix: %s", p);
+	mix[i] += weight;
+	mix_total += weight;
+    }
+    free(s);
+    if (mix_total == 0)
+	errx(1, "empty request mix");
+}
+
+static int
+pick_request(void)
+{
+    unsigned r = rand() % mix_total;
+    int i;
+
+    for (i = 0; i < REQ_MAX - 1; i++) {
+	if (r < mix[i])
+	    break;
+	r -= mix[i];
+    }
+    return i;
+}
+
+static uint64_t
+now_usec(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 static void
-generate_requests (const char *filename, unsigned nreq)
+stats_add(struct stats *st, int type, uint64_t usec, krb5_error_code code)
+{
+    unsigned b;
+    int i;
+
+    st->requests[type]++;
+    st->total_usec += usec;
+    if (st->min_usec == 0 || usec < st->min_usec)
+	st->min_usec = usec;
+    if (usec > st->max_usec)
+	st->max_usec = usec;
+    for (b = 0; b < NBUCKETS - 1 && (usec >> b) > 1; b++)
+	;
+    st->histogram[b]++;
+
+    if (code == 0)
+	return;
+    st->failed++;
+    for (i = 0; i < NERRORS; i++) {
+	if (st->errors[i].count == 0)
+	    st->errors[i].code = code;
+	if (st->errors[i].code == code) {
+	    st->errors[i].count++;
+	    return;
+	}
+    }
+    st->other_errors++;
+}
+
+static void
+stats_merge(struct stats *st, const struct stats *o)
+{
+    size_t i, j;
+
+    for (i = 0; i < REQ_MAX; i++)
+	st->requests[i] += o->requests[i];
+    st->failed += o->failed;
+    st->total_usec += o->total_usec;
+    if (o->min_usec && (st->min_usec == 0 || o->min_usec < st->min_usec))
+	st->min_usec = o->min_usec;
+    if (o->max_usec > st->max_usec)
+	st->max_usec = o->max_usec;
+    for (i = 0; i < NBUCKETS; i++)
+	st->histogram[i] += o->histogram[i];
+    st->other_errors += o->other_errors;
+    for (i = 0; i < NERRORS && o->errors[i].count; i++) {
+	for (j = 0; j < NERRORS; j++) {
+	    if (st->errors[j].count == 0)
+		st->errors[j].code = o->errors[i].code;
+	    if (st->errors[j].code == o->errors[i].code) {
+		st->errors[j].count += o->errors[i].count;
+		break;
+	    }
+	}
+	if (j == NERRORS)
+	    st->other_errors += o->errors[i].count;
+    }
+}
+
+/* upper bound of the bucket holding the given fraction of requests */
+static uint64_t
+stats_percentile(const struct stats *st, unsigned long total, double q)
+{
+    unsigned long n = 0;
+    unsigned b;
+
+    for (b = 0; b < NBUCKETS; b++) {
+	n += st->histogram[b];
+	if (n >= total * q)
+	    break;
+    }
+    return (uint64_t)2 << b;
+}
+
+static void
+stats_print(krb5_context context, const struct stats *st, uint64_t usec)
+{
+    unsigned long total = 0;
+    unsigned b;
+    int i;
+
+    for (i = 0; i < REQ_MAX; i++)
+	total += st->requests[i];
+    if (total == 0) {
+	printf("no requests\n");
+	return;
+    }
+
+    printf("requests: %lu", total);
+    for (i = 0; i < REQ_MAX; i++)
+	if (st->requests[i])
+	    printf(" %s %lu", req_names[i], st->requests[i]);
+    printf(", failed %lu\n", st->failed);
+    printf("elapsed: %.3f s, %.1f requests/s\n",
+	   usec / 1e6, usec ? total * 1e6 / usec : 0.0);
+    printf("latency (us): min %llu mean %llu max %llu\n",
+	   (unsigned long long)st->min_usec,
+	   (unsigned long long)(st->total_usec / total),
+	   (unsigned long long)st->max_usec);
+    printf("latency (us, bucket bound): p50 %llu p90 %llu p99 %llu\n",
+	   (unsigned long long)stats_percentile(st, total, 0.50),
+	   (unsigned long long)stats_percentile(st, total, 0.90),
+	   (unsigned long long)stats_percentile(st, total, 0.99));
+
+    printf("histogram:\n");
+    for (b = 0; b < NBUCKETS; b++)
+	if (st->histogram[b])
+	    printf("  < %10llu us %10lu\n",
+		   (unsigned long long)2 << b, st->histogram[b]);
+
+    if (st->failed == 0)
+	return;
+    printf("errors:\n");
+    for (i = 0; i < NERRORS && st->errors[i].count; i++) {
+	const char *msg;
+
+	msg = krb5_get_error_message(context, st->errors[i].code);
+	printf("  %10lu %d %s\n", st->errors[i].count,
+	       st->errors[i].code, msg);
+	krb5_free_error_message(context, msg);
+    }
+    if (st->other_errors)
+	printf("  %10lu other\n", st->other_errors);
+}
+
+static krb5_error_code
+request_as(krb5_context context, const char *name)
 {
     krb5_principal client;
-    krb5_context context;
     krb5_error_code ret;
     krb5_creds cred;
-    int i;
-    char **words;
-    unsigned nwords;
+
+    memset(&cred, 0, sizeof(cred));
+
+    ret = krb5_parse_name(context, name, &client);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_parse_name %s", name);
+
+    ret = krb5_get_init_creds_password(context, &cred, client, password_str,
+				       NULL, NULL, 0, NULL, NULL);
+    krb5_free_cred_contents(context, &cred);
+    krb5_free_principal(context, client);
+    return ret;
+}
+
+static krb5_error_code
+request_tgs(krb5_context context, krb5_ccache cache,
+	    krb5_const_principal self, int type, const char *name)
+{
+    krb5_get_creds_opt opt;
+    krb5_principal principal;
+    krb5_error_code ret;
+    krb5_creds *out = NULL;
+
+    ret = krb5_parse_name(context, name, &principal);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_parse_name %s", name);
+
+    ret = krb5_get_creds_opt_alloc(context, &opt);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_get_creds_opt_alloc");
+    krb5_get_creds_opt_add_options(context, opt, KRB5_GC_NO_STORE);
+
+    if (type == REQ_S4U) {
+	krb5_get_creds_opt_set_impersonate(context, opt, principal);
+	ret = krb5_get_creds(context, opt, cache, self, &out);
+    } else
+	ret = krb5_get_creds(context, opt, cache, principal, &out);
+
+    if (out)
+	krb5_free_creds(context, out);
+    krb5_get_creds_opt_free(context, opt);
+    krb5_free_principal(context, principal);
+    return ret;
+}
+
+static void
+generate_requests (char **words, unsigned nwords, unsigned nreq,
+		   struct stats *st)
+{
+    krb5_context context;
+    krb5_ccache cache = NULL;
+    krb5_principal self = NULL;
+    krb5_error_code ret;
+    uint64_t start, begin, end;
+    unsigned i;
+    int type;
 
     ret = krb5_init_context (&context);
     if (ret)
 	errx (1, "krb5_init_context failed: %d", ret);
 
-    nwords = read_words (filename, &words);
+    if (mix[REQ_TGS] || mix[REQ_S4U]) {
+	if (cache_str)
+	    ret = krb5_cc_resolve(context, cache_str, &cache);
+	else
+	    ret = krb5_cc_default(context, &cache);
+	if (ret)
+	    krb5_err(context, 1, ret, "resolving credentials cache");
+	ret = krb5_cc_get_principal(context, cache, &self);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_cc_get_principal");
+    }
 
+    start = now_usec();
     for (i = 0; i < nreq; ++i) {
 	char *name = words[rand() % nwords];
 
-	memset(&cred, 0, sizeof(cred));
+	type = pick_request();
 
-	ret = krb5_parse_name (context, name, &client);
-	if (ret)
-	    krb5_err (context, 1, ret, "krb5_parse_name %s", name);
+	/*
+	 * With a fixed rate the latency is measured from when the
+	 * request should have been sent, so that a slow KDC is not
+	 * hidden by the generator slowing down with it.
+	 */
+	if (rate) {
+	    begin = start + (uint64_t)i * 1000000 / rate;
+	    end = now_usec();
+	    if (begin > end)
+		usleep(begin - end);
+	} else
+	    begin = now_usec();
 
-	ret = krb5_get_init_creds_password (context, &cred, client, "",
-					    NULL, NULL, 0, NULL, NULL);
-	if (ret)
-	    krb5_free_cred_contents (context, &cred);
-	krb5_free_principal(context, client);
+	if (type == REQ_AS)
+	    ret = request_as(context, name);
+	else
+	    ret = request_tgs(context, cache, self, type, name);
+
+	end = now_usec();
+	stats_add(st, type, end > begin ? end - begin : 0, ret);
     }
+
+    if (self)
+	krb5_free_principal(context, self);
+    if (cache)
+	krb5_cc_close(context, cache);
+    krb5_free_context(context);
 }
 
-static int version_flag	= 0;
-static int help_flag	= 0;
+#ifndef _WIN32
+
+/*
+ * Run the requests in several processes, each with its own context,
+ * and collect their statistics over a pipe.
+ */
+
+static void
+generate_requests_processes (char **words, unsigned nwords, unsigned nreq,
+			     struct stats *st)
+{
+    struct stats child;
+    int *fds, fd[2], status;
+    pid_t pid;
+    int i;
+
+    fds = ecalloc(processes, sizeof(fds[0]));
+
+    for (i = 0; i < processes; i++) {
+	if (pipe(fd) < 0)
+	    err(1, "pipe");
+	pid = fork();
+	if (pid < 0)
+	    err(1, "fork");
+	if (pid == 0) {
+	    close(fd[0]);
+	    srand(i);
+	    memset(&child, 0, sizeof(child));
+	    generate_requests(words, nwords,
+			      nreq / processes + ((unsigned)i < nreq % processes),
+			      &child);
+	    if (net_write(fd[1], &child, sizeof(child)) != sizeof(child))
+		err(1, "write");
+	    _exit(0);
+	}
+	close(fd[1]);
+	fds[i] = fd[0];
+    }
+
+    for (i = 0; i < processes; i++) {
+	if (net_read(fds[i], &child, sizeof(child)) != sizeof(child))
+	    errx(1, "process %d exited without statistics", i);
+	close(fds[i]);
+	stats_merge(st, &child);
+    }
+    while (wait(&status) > 0)
+	;
+    free(fds);
+}
+
+#endif
 
 static struct getargs args[] = {
+    { "mix",		'm', arg_string, &mix_str,
+      "request types and weights", "as[:n],tgs[:n],s4u[:n]" },
+    { "password",	'p', arg_string, &password_str,
+      "password for AS requests", "password" },
+    { "cache",		'c', arg_string, &cache_str,
+      "credentials cache for TGS and S4U2Self requests", "cachename" },
+    { "rate",		'r', arg_integer, &rate,
+      "requests per second in each process, 0 for as fast as possible",
+      "number" },
+#ifndef _WIN32
+    { "processes",	'P', arg_integer, &processes,
+      "number of processes sending requests", "number" },
+#endif
     { "version", 	0,   arg_flag, &version_flag, NULL, NULL },
     { "help",		0,   arg_flag, &help_flag,    NULL, NULL }
 };
@@ -115,9 +480,15 @@ usage (int ret)
 int
 main(int argc, char **argv)
 {
+    krb5_context context;
+    krb5_error_code ret;
+    struct stats st;
+    uint64_t start;
     int optidx = 0;
     int nreq;
     char *end;
+    char **words;
+    unsigned nwords;
 
     setprogname(argv[0]);
     if(getarg(args, sizeof(args) / sizeof(args[0]), argc, argv, &optidx))
@@ -138,8 +509,27 @@ main(int argc, char **argv)
 	usage (1);
     srand (0);
     nreq = strtol (argv[1], &end, 0);
-    if (argv[1] == end || *end != '\0')
+    if (argv[1] == end || *end != '\0' || nreq < 0)
 	usage (1);
-    generate_requests (argv[0], nreq);
+    if (rate < 0 || processes < 1)
+	usage (1);
+    parse_mix(mix_str);
+
+    nwords = read_words (argv[0], &words);
+
+    memset(&st, 0, sizeof(st));
+    start = now_usec();
+#ifndef _WIN32
+    if (processes > 1)
+	generate_requests_processes (words, nwords, nreq, &st);
+    else
+#endif
+	generate_requests (words, nwords, nreq, &st);
+
+    ret = krb5_init_context (&context);
+    if (ret)
+	errx (1, "krb5_init_context failed: %d", ret);
+    stats_print(context, &st, now_usec() - start);
+    krb5_free_context(context);
     return 0;
 }
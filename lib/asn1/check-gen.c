@@ -1503,8 +1503,8 @@ check_TESTMechTypeList(void)
                             { 7, oid2 },
                             { 10, oid3 },
                             { 10, oid4 }};
-    size_t size, len;
-    void *ptr;
+    size_t size, len, len2;
+    void *ptr, *ptr2;
     int ret;
 
     tl.len = 4;
@@ -1515,6 +1515,22 @@ check_TESTMechTypeList(void)
 	errx(1, "TESTMechTypeList: %d", ret);
     if (len != size)
 	abort();
+
+    DER_MALLOC_ENCODE(TESTMechTypeList, ptr2, len2, &tl, &size, ret);
+    if (ret)
+	errx(1, "TESTMechTypeList single pass: %d", ret);
+    if (len2 != size || len2 != len || memcmp(ptr, ptr2, len) != 0)
+	errx(1, "TESTMechTypeList single pass differs");
+    free(ptr2);
+
+    /* too small hint, falls back to length_TESTMechTypeList() */
+    DER_MALLOC_ENCODE_HINT(TESTMechTypeList, ptr2, len2, &tl, &size, ret, 3);
+    if (ret)
+	errx(1, "TESTMechTypeList small hint: %d", ret);
+    if (len2 != size || len2 != len || memcmp(ptr, ptr2, len) != 0)
+	errx(1, "TESTMechTypeList small hint differs");
+    free(ptr2);
+    free(ptr);
     return 0;
 }
 
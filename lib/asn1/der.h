@@ -100,6 +100,44 @@ struct asn1_template;
 
 #include <der-protos.h>
 
+/*
+ * Like ASN1_MALLOC_ENCODE() but without the separate length_T() pass
+ * in the common case: the value is encoded into a buffer of `H' bytes
+ * (DER_ENCODE_HINT for DER_MALLOC_ENCODE()), and length_T() is only
+ * used to size the buffer when that overflows.
+ */
+
+#define DER_ENCODE_HINT 4096
+
+#define DER_MALLOC_ENCODE(T, B, BL, S, L, R)				\
+    DER_MALLOC_ENCODE_HINT(T, B, BL, S, L, R, DER_ENCODE_HINT)
+
+#define DER_MALLOC_ENCODE_HINT(T, B, BL, S, L, R, H)			\
+    do {								\
+	unsigned char *_der_p;						\
+	size_t _der_len = (H);						\
+	void *_der_buf;							\
+	_der_p = malloc(_der_len);					\
+	if (_der_p == NULL) {						\
+	    (R) = ENOMEM;						\
+	} else {							\
+	    (R) = encode_##T(_der_p + _der_len - 1, _der_len, (S), (L)); \
+	    if ((R) == ASN1_OVERFLOW) {					\
+		free(_der_p);						\
+		_der_len = length_##T((S));				\
+		_der_p = malloc(_der_len ? _der_len : 1);		\
+		if (_der_p == NULL)					\
+		    (R) = ENOMEM;					\
+		else							\
+		    (R) = encode_##T(_der_p + _der_len - 1, _der_len,	\
+				     (S), (L));				\
+	    }								\
+	}								\
+	(R) = der_malloc_encode_done((R), _der_p, _der_len, (L),	\
+				     &_der_buf, &(BL));			\
+	(B) = _der_buf;							\
+    } while (0)
+
 int _heim_fix_dce(size_t reallen, size_t *len);
 int _heim_der_set_sort(const void *, const void *);
 int _heim_time2generalizedtime (time_t, heim_octet_string *, int);
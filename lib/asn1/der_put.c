@@ -550,3 +550,38 @@ _heim_der_set_sort(const void *a1, const void *a2)
 	return ret;
     return (int)(s1->length - s2->length);
 }
+
+/*
+ * Finish a DER_MALLOC_ENCODE(): `p' is the `len' byte buffer the
+ * encoder returned `ret' for, with the `*size' encoded bytes at its
+ * end.  On success the encoding is moved to the front of the buffer,
+ * which is returned in `buf' and its length in `buflen'; on failure
+ * the buffer is freed.
+ */
+
+int
+der_malloc_encode_done(int ret, unsigned char *p, size_t len,
+		       const size_t *size, void **buf, size_t *buflen)
+{
+    unsigned char *q;
+    size_t l;
+
+    *buf = NULL;
+    *buflen = 0;
+
+    if (ret) {
+	free(p);
+	return ret;
+    }
+
+    l = *size;
+    if (l != len)
+	memmove(p, p + len - l, l);
+    /* don't keep a mostly empty buffer around */
+    if (len - l > l && (q = realloc(p, l ? l : 1)) != NULL)
+	p = q;
+
+    *buf = p;
+    *buflen = l;
+    return 0;
+}
@@ -90,6 +90,10 @@
 #define heim_base_exchange_pointer(t,v) __sync_lock_test_and_set((t), (v))
 #endif
 
+#define heim_base_memory_barrier() __sync_synchronize()
+#define heim_base_once_done(o) \
+    (*(volatile heim_base_once_t *)(o) == 2 && (__sync_synchronize(), 1))
+
 #elif defined(_WIN32)
 
 #define heim_base_atomic_inc(x) InterlockedIncrement(x)
@@ -99,6 +103,10 @@
 
 #define heim_base_exchange_pointer(t,v) InterlockedExchangePointer((t),(v))
 
+#define heim_base_memory_barrier() MemoryBarrier()
+#define heim_base_once_done(o) \
+    (*(volatile heim_base_once_t *)(o) == 2 && (MemoryBarrier(), 1))
+
 #else
 
 #define HEIM_BASE_NEED_ATOMIC_MUTEX 1
@@ -128,6 +136,9 @@ heim_base_atomic_dec(heim_base_atomic_type *x)
 
 #define heim_base_atomic_max    UINT_MAX
 
+#define heim_base_memory_barrier() do { } while (0)
+#define heim_base_once_done(o) 0
+
 #endif
 
 /* tagged strings/object/XXX */
@@ -372,12 +372,19 @@ heim_base_once_f(heim_base_once_t *once, void *ctx, void (*func)(void *))
     dispatch_once_f(once, ctx, func);
 #else
     static HEIMDAL_MUTEX mutex = HEIMDAL_MUTEX_INITIALIZER;
+
+    /* Once done, callers need not serialize on the mutex */
+    if (heim_base_once_done(once))
+	return;
+
     HEIMDAL_MUTEX_lock(&mutex);
     if (*once == 0) {
 	*once = 1;
 	HEIMDAL_MUTEX_unlock(&mutex);
 	func(ctx);
 	HEIMDAL_MUTEX_lock(&mutex);
+	/* Publish what func() did before readers not taking the mutex see 2 */
+	heim_base_memory_barrier();
 	*once = 2;
 	HEIMDAL_MUTEX_unlock(&mutex);
     } else if (*once == 2) {
@@ -35,15 +35,28 @@
 
 #define DEFAULT_JITTER_WINDOW 20
 
+/*
+ * Sequence numbers are tracked with a sliding window bitmap in the
+ * style of RFC 4303: `last' is the highest sequence number seen and
+ * bit (n % nbits) records whether n was seen, for n in the window
+ * (last - jitter_window, last].  The bitmap is circular, so moving the
+ * window only clears the bits it moves over.
+ */
+
 struct gss_msg_order {
+    HEIMDAL_MUTEX mutex;	/* receivers don't need the context lock */
     OM_uint32 flags;
     OM_uint32 start;
-    OM_uint32 length;
     OM_uint32 jitter_window;
     OM_uint32 first_seq;
-    OM_uint32 elem[1];
+    OM_uint32 last;		/* highest sequence number seen */
+    int seen;			/* any sequence number seen yet */
+    OM_uint32 nbits;		/* size of bitmap, a power of two */
+    uint32_t bitmap[1];
 };
 
+#define BIT(o, n)	((o)->bitmap[((n) & ((o)->nbits - 1)) / 32])
+#define MASK(n)		(1U << ((n) % 32))
 
 /*
  *
@@ -54,17 +67,28 @@ msg_order_alloc(OM_uint32 *minor_status,
 		struct gss_msg_order **o,
 		OM_uint32 jitter_window)
 {
+    OM_uint32 nbits;
     size_t len;
 
-    len = jitter_window * sizeof((*o)->elem[0]);
+    /* Leave a word of slack so the window never wraps onto itself */
+    for (nbits = 32; nbits < jitter_window + 32; nbits <<= 1)
+	if (nbits >= (1U << 31)) {
+	    *minor_status = EINVAL;
+	    return GSS_S_FAILURE;
+	}
+
+    len = (nbits / 32) * sizeof((*o)->bitmap[0]);
     len += sizeof(**o);
-    len -= sizeof((*o)->elem[0]);
+    len -= sizeof((*o)->bitmap[0]);
 
     *o = calloc(1, len);
     if (*o == NULL) {
 	*minor_status = ENOMEM;
 	return GSS_S_FAILURE;
     }
+    HEIMDAL_MUTEX_init(&(*o)->mutex);
+    (*o)->nbits = nbits;
+    (*o)->jitter_window = jitter_window;
 
     *minor_status = 0;
     return GSS_S_COMPLETE;
@@ -92,10 +116,8 @@ _gssapi_msg_order_create(OM_uint32 *minor_status,
         return ret;
 
     (*o)->flags = flags;
-    (*o)->length = 0;
     (*o)->first_seq = seq_num;
-    (*o)->jitter_window = jitter_window;
-    (*o)->elem[0] = seq_num - 1;
+    (*o)->last = seq_num - 1;
 
     *minor_status = 0;
     return GSS_S_COMPLETE;
@@ -104,32 +126,31 @@ _gssapi_msg_order_create(OM_uint32 *minor_status,
 OM_uint32
 _gssapi_msg_order_destroy(struct gss_msg_order **m)
 {
+    if (*m)
+	HEIMDAL_MUTEX_destroy(&(*m)->mutex);
     free(*m);
     *m = NULL;
     return GSS_S_COMPLETE;
 }
 
-static void
-elem_set(struct gss_msg_order *o, unsigned int slot, OM_uint32 val)
-{
-    o->elem[slot % o->jitter_window] = val;
-}
+/*
+ * Move the window forward so that it ends at seq_num, and mark it.
+ */
 
 static void
-elem_insert(struct gss_msg_order *o,
-	    unsigned int after_slot,
-	    OM_uint32 seq_num)
+window_advance(struct gss_msg_order *o, OM_uint32 seq_num)
 {
-    assert(o->jitter_window > after_slot);
-
-    if (o->length > after_slot)
-	memmove(&o->elem[after_slot + 1], &o->elem[after_slot],
-		(o->length - after_slot - 1) * sizeof(o->elem[0]));
+    OM_uint32 n, diff = seq_num - o->last;
 
-    elem_set(o, after_slot, seq_num);
-
-    if (o->length < o->jitter_window)
-	o->length++;
+    if (!o->seen || diff >= o->nbits) {
+	memset(o->bitmap, 0, (o->nbits / 32) * sizeof(o->bitmap[0]));
+    } else {
+	for (n = o->last + 1; n != seq_num; n++)
+	    BIT(o, n) &= ~MASK(n);
+    }
+    BIT(o, seq_num) |= MASK(seq_num);
+    o->last = seq_num;
+    o->seen = 1;
 }
 
 /* rule 1: expected sequence number */
@@ -137,33 +158,24 @@ elem_insert(struct gss_msg_order *o,
 /* rule 3: seqnum < seqnum(first) */
 /* rule 4+5: seqnum in [seqnum(first),seqnum(last)]  */
 
-OM_uint32
-_gssapi_msg_order_check(struct gss_msg_order *o, OM_uint32 seq_num)
+static OM_uint32
+msg_order_check(struct gss_msg_order *o, OM_uint32 seq_num)
 {
+    OM_uint32 behind;
     OM_uint32 r;
-    size_t i;
-
-    if (o == NULL)
-	return GSS_S_COMPLETE;
-
-    if ((o->flags & (GSS_C_REPLAY_FLAG|GSS_C_SEQUENCE_FLAG)) == 0)
-	return GSS_S_COMPLETE;
 
     /* check if the packet is the next in order */
-    if (o->elem[0] == seq_num - 1) {
-	elem_insert(o, 0, seq_num);
+    if (o->last == seq_num - 1) {
+	window_advance(o, seq_num);
 	return GSS_S_COMPLETE;
     }
 
     r = (o->flags & (GSS_C_REPLAY_FLAG|GSS_C_SEQUENCE_FLAG))==GSS_C_REPLAY_FLAG;
 
-    /* sequence number larger then largest sequence number
-     * or smaller then the first sequence number */
-    if (seq_num > o->elem[0]
-	|| seq_num < o->first_seq
-	|| o->length == 0)
-    {
-	elem_insert(o, 0, seq_num);
+    /* sequence number larger than the largest sequence number */
+    behind = o->last - seq_num;
+    if (!o->seen || behind >= (1U << 31)) {
+	window_advance(o, seq_num);
 	if (r) {
 	    return GSS_S_COMPLETE;
 	} else {
@@ -171,33 +183,44 @@ _gssapi_msg_order_check(struct gss_msg_order *o, OM_uint32 seq_num)
 	}
     }
 
-    assert(o->length > 0);
-
-    /* sequence number smaller the first sequence number */
-    if (seq_num < o->elem[o->length - 1]) {
+    /* sequence number older than the window */
+    if (behind >= o->jitter_window) {
 	if (r)
 	    return(GSS_S_OLD_TOKEN);
 	else
 	    return(GSS_S_UNSEQ_TOKEN);
     }
 
-    if (seq_num == o->elem[o->length - 1]) {
+    if (BIT(o, seq_num) & MASK(seq_num))
 	return GSS_S_DUPLICATE_TOKEN;
-    }
 
-    for (i = 0; i < o->length - 1; i++) {
-	if (o->elem[i] == seq_num)
-	    return GSS_S_DUPLICATE_TOKEN;
-	if (o->elem[i + 1] < seq_num && o->elem[i] < seq_num) {
-	    elem_insert(o, i, seq_num);
-	    if (r)
-		return GSS_S_COMPLETE;
-	    else
-		return GSS_S_UNSEQ_TOKEN;
-	}
-    }
+    BIT(o, seq_num) |= MASK(seq_num);
+    if (r)
+	return GSS_S_COMPLETE;
+    else
+	return GSS_S_UNSEQ_TOKEN;
+}
 
-    return GSS_S_FAILURE;
+/*
+ * Check `seq_num' against the window and record it.  This takes the
+ * window's own lock, so callers need not hold the context lock.
+ */
+
+OM_uint32
+_gssapi_msg_order_check(struct gss_msg_order *o, OM_uint32 seq_num)
+{
+    OM_uint32 ret;
+
+    if (o == NULL)
+	return GSS_S_COMPLETE;
+
+    if ((o->flags & (GSS_C_REPLAY_FLAG|GSS_C_SEQUENCE_FLAG)) == 0)
+	return GSS_S_COMPLETE;
+
+    HEIMDAL_MUTEX_lock(&o->mutex);
+    ret = msg_order_check(o, seq_num);
+    HEIMDAL_MUTEX_unlock(&o->mutex);
+    return ret;
 }
 
 OM_uint32
@@ -208,13 +231,25 @@ _gssapi_msg_order_f(OM_uint32 flags)
 
 /*
  * Translate `o` into inter-process format and export in to `sp'.
+ *
+ * The format predates the bitmap: after the header comes a list of
+ * jitter_window sequence numbers, the first `length' of which are
+ * those seen, newest first.
  */
 
-krb5_error_code
-_gssapi_msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
+static krb5_error_code
+msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
 {
     krb5_error_code kret;
-    OM_uint32 i;
+    OM_uint32 i, n, length = 0;
+
+    if (o->seen) {
+	for (i = 0; i < o->jitter_window; i++) {
+	    n = o->last - i;
+	    if (BIT(o, n) & MASK(n))
+		length++;
+	}
+    }
 
     kret = krb5_store_int32(sp, o->flags);
     if (kret)
@@ -222,7 +257,7 @@ _gssapi_msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
     kret = krb5_store_int32(sp, o->start);
     if (kret)
         return kret;
-    kret = krb5_store_int32(sp, o->length);
+    kret = krb5_store_int32(sp, length);
     if (kret)
         return kret;
     kret = krb5_store_int32(sp, o->jitter_window);
@@ -232,8 +267,21 @@ _gssapi_msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
     if (kret)
         return kret;
 
-    for (i = 0; i < o->jitter_window; i++) {
-        kret = krb5_store_int32(sp, o->elem[i]);
+    /* The newest entry doubles as `last' when nothing was seen yet */
+    kret = krb5_store_int32(sp, o->last);
+    if (kret)
+	return kret;
+    n = 1;
+    for (i = 1; o->seen && i < o->jitter_window; i++) {
+	if ((BIT(o, o->last - i) & MASK(o->last - i)) == 0)
+	    continue;
+	kret = krb5_store_int32(sp, o->last - i);
+	if (kret)
+	    return kret;
+	n++;
+    }
+    for (; n < o->jitter_window; n++) {
+	kret = krb5_store_int32(sp, 0);
 	if (kret)
 	    return kret;
     }
@@ -241,6 +289,17 @@ _gssapi_msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
     return 0;
 }
 
+krb5_error_code
+_gssapi_msg_order_export(krb5_storage *sp, struct gss_msg_order *o)
+{
+    krb5_error_code kret;
+
+    HEIMDAL_MUTEX_lock(&o->mutex);
+    kret = msg_order_export(sp, o);
+    HEIMDAL_MUTEX_unlock(&o->mutex);
+    return kret;
+}
+
 OM_uint32
 _gssapi_msg_order_import(OM_uint32 *minor_status,
 			 krb5_storage *sp,
@@ -248,7 +307,7 @@ _gssapi_msg_order_import(OM_uint32 *minor_status,
 {
     OM_uint32 ret;
     krb5_error_code kret;
-    int32_t i, flags, start, length, jitter_window, first_seq;
+    int32_t i, flags, start, length, jitter_window, first_seq, seq;
 
     kret = krb5_ret_int32(sp, &flags);
     if (kret)
@@ -266,20 +325,31 @@ _gssapi_msg_order_import(OM_uint32 *minor_status,
     if (kret)
 	goto failed;
 
+    if (jitter_window <= 0 || length < 0 || length > jitter_window) {
+	*minor_status = EINVAL;
+	return GSS_S_FAILURE;
+    }
+
     ret = msg_order_alloc(minor_status, o, jitter_window);
     if (ret != GSS_S_COMPLETE)
         return ret;
 
     (*o)->flags = flags;
     (*o)->start = start;
-    (*o)->length = length;
-    (*o)->jitter_window = jitter_window;
     (*o)->first_seq = first_seq;
 
     for( i = 0; i < jitter_window; i++ ) {
-        kret = krb5_ret_int32(sp, (int32_t*)&((*o)->elem[i]));
+        kret = krb5_ret_int32(sp, &seq);
 	if (kret)
 	    goto failed;
+	if (i == 0) {
+	    (*o)->last = seq;
+	    if (length == 0)
+		continue;
+	    (*o)->seen = 1;
+	}
+	if (i < length && (*o)->last - (OM_uint32)seq < (OM_uint32)jitter_window)
+	    BIT(*o, (OM_uint32)seq) |= MASK((OM_uint32)seq);
     }
 
     *minor_status = 0;
@@ -78,6 +78,13 @@ OM_uint32 pattern8[] = {
     4294967293U, 4294967294U, 4294967295U, 0, 1, 2
 };
 
+/* older than the window */
+OM_uint32 pattern9[] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+    10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+    20, 21, 22, 23, 24, 25, 3
+};
+
 static int
 test_seq(int t, OM_uint32 flags, OM_uint32 start_seq,
 	 OM_uint32 *pattern, int pattern_len, OM_uint32 expected_error)
@@ -344,6 +351,18 @@ struct {
 	sizeof(pattern8)/sizeof(pattern8[0]),
 	GSS_S_COMPLETE,
 	4294967293U
+    },
+    {
+	GSS_C_REPLAY_FLAG,
+	pattern9,
+	sizeof(pattern9)/sizeof(pattern9[0]),
+	GSS_S_OLD_TOKEN
+    },
+    {
+	GSS_C_SEQUENCE_FLAG,
+	pattern9,
+	sizeof(pattern9)/sizeof(pattern9[0]),
+	GSS_S_UNSEQ_TOKEN
     }
 };
 
@@ -28,6 +28,7 @@
 
 #include "mech_locl.h"
 #include <heim_threads.h>
+#include <heimbase.h>
 
 #ifndef _PATH_GSS_MECH
 #define _PATH_GSS_MECH	"/etc/gss/mech"
@@ -35,7 +36,14 @@
 
 struct _gss_mech_switch_list _gss_mechs = { NULL } ;
 gss_OID_set _gss_mech_oids;
-static HEIMDAL_MUTEX _gss_mech_mutex = HEIMDAL_MUTEX_INITIALIZER;
+static heim_base_once_t _gss_mech_once = HEIM_BASE_ONCE_INIT;
+
+/*
+ * Open addressed OID -> mechanism table.  It is built once, after all
+ * mechanisms are loaded, and never changes, so lookups need no lock.
+ */
+static struct _gss_mech_switch **_gss_mech_table;
+static size_t _gss_mech_table_mask;
 
 /*
  * Convert a string containing an OID in 'dot' form
@@ -220,11 +228,47 @@ add_builtin(gssapi_mech_interface mech)
     return 0;
 }
 
+static size_t
+mech_oid_hash(gss_const_OID oid)
+{
+    const unsigned char *p = oid->elements;
+    size_t i, h = 2166136261U;
+
+    for (i = 0; i < oid->length; i++)
+	h = (h ^ p[i]) * 16777619U;
+    return h;
+}
+
+static void
+build_mech_table(void)
+{
+    struct _gss_mech_switch *m;
+    size_t i, n = 0, size;
+
+    HEIM_SLIST_FOREACH(m, &_gss_mechs, gm_link)
+	n++;
+    for (size = 8; size < n * 2; size <<= 1)
+	;
+
+    /* If this fails __gss_get_mechanism() walks the list instead */
+    _gss_mech_table = calloc(size, sizeof(_gss_mech_table[0]));
+    if (_gss_mech_table == NULL)
+	return;
+    _gss_mech_table_mask = size - 1;
+
+    HEIM_SLIST_FOREACH(m, &_gss_mechs, gm_link) {
+	i = mech_oid_hash(&m->gm_mech.gm_mech_oid) & _gss_mech_table_mask;
+	while (_gss_mech_table[i] != NULL)
+	    i = (i + 1) & _gss_mech_table_mask;
+	_gss_mech_table[i] = m;
+    }
+}
+
 /*
  * Load the mechanisms file (/etc/gss/mech).
  */
-void
-_gss_load_mech(void)
+static void
+load_mechs(void *ctx)
 {
 	OM_uint32	major_status, minor_status;
 	FILE		*fp;
@@ -236,20 +280,10 @@ _gss_load_mech(void)
 	gss_OID_desc	mech_oid;
 	int		found;
 
-
-	HEIMDAL_MUTEX_lock(&_gss_mech_mutex);
-
-	if (HEIM_SLIST_FIRST(&_gss_mechs)) {
-		HEIMDAL_MUTEX_unlock(&_gss_mech_mutex);
-		return;
-	}
-
 	major_status = gss_create_empty_oid_set(&minor_status,
 	    &_gss_mech_oids);
-	if (major_status) {
-		HEIMDAL_MUTEX_unlock(&_gss_mech_mutex);
+	if (major_status)
 		return;
-	}
 
 	add_builtin(__gss_krb5_initialize());
 	add_builtin(__gss_spnego_initialize());
@@ -258,7 +292,7 @@ _gss_load_mech(void)
 #ifdef HAVE_DLOPEN
 	fp = fopen(_PATH_GSS_MECH, "r");
 	if (!fp) {
-		HEIMDAL_MUTEX_unlock(&_gss_mech_mutex);
+		build_mech_table();
 		return;
 	}
 	rk_cloexec_file(fp);
@@ -424,15 +458,37 @@ _gss_load_mech(void)
 	}
 	fclose(fp);
 #endif
-	HEIMDAL_MUTEX_unlock(&_gss_mech_mutex);
+	build_mech_table();
+}
+
+/*
+ * Load the builtin mechanisms and those in the mechanisms file.  This
+ * is done once; afterwards the mechanism list is never modified.
+ */
+void
+_gss_load_mech(void)
+{
+	heim_base_once_f(&_gss_mech_once, NULL, load_mechs);
 }
 
 gssapi_mech_interface
 __gss_get_mechanism(gss_const_OID mech)
 {
         struct _gss_mech_switch	*m;
+	size_t i;
 
 	_gss_load_mech();
+	if (_gss_mech_table != NULL) {
+		if (mech == GSS_C_NO_OID)
+			return NULL;
+		i = mech_oid_hash(mech) & _gss_mech_table_mask;
+		for (; (m = _gss_mech_table[i]) != NULL;
+		     i = (i + 1) & _gss_mech_table_mask) {
+			if (gss_oid_equal(&m->gm_mech.gm_mech_oid, mech))
+				return &m->gm_mech;
+		}
+		return NULL;
+	}
 	HEIM_SLIST_FOREACH(m, &_gss_mechs, gm_link) {
 		if (gss_oid_equal(&m->gm_mech.gm_mech_oid, mech))
 			return &m->gm_mech;
@@ -42,7 +42,9 @@
 #include <hex.h>
 
 static krb5_error_code LDAP__connect(krb5_context context, HDB *);
-static krb5_error_code LDAP_close(krb5_context context, HDB *);
+static krb5_error_code LDAP__disconnect(krb5_context context, HDB *);
+static int LDAP__search(krb5_context, HDB *, const char *, const char *,
+			char **, LDAPMessage **);
 
 static krb5_error_code
 LDAP_message2entry(krb5_context context, HDB * db, LDAPMessage * msg,
@@ -53,6 +55,12 @@ static char *structural_object;
 static const char *default_ldap_url = "ldapi:///";
 static krb5_boolean samba_forwardable;
 
+/*
+ * Optional cache of recent lookups, see hdb-ldap-cache-ttl.  A KDC
+ * looks up the same krbtgt and service principals over and over.
+ */
+#define HDB_LDAP_CACHE_SIZE 64
+
 struct hdbldapdb {
     LDAP *h_lp;
     int   h_msgid;
@@ -62,6 +70,15 @@ struct hdbldapdb {
     char *h_bind_password;
     krb5_boolean h_start_tls;
     char *h_createbase;
+    krb5_boolean h_keep;
+    time_t h_cache_ttl;
+    unsigned h_cache_next;
+    struct ldap_cache_entry {
+	char *name;
+	unsigned flags;
+	time_t expires;
+	hdb_entry_ex entry;
+    } h_cache[HDB_LDAP_CACHE_SIZE];
 };
 
 #define HDB2LDAP(db) (((struct hdbldapdb *)(db)->hdb_db)->h_lp)
@@ -140,7 +157,7 @@ check_ldap(krb5_context context, HDB *db, int ret)
     case LDAP_SUCCESS:
 	return 0;
     case LDAP_SERVER_DOWN:
-	LDAP_close(context, db);
+	LDAP__disconnect(context, db);
 	return 1;
     default:
 	return 1;
@@ -757,10 +774,7 @@ LDAP_dn2principal(krb5_context context, HDB * db, const char *dn,
     if (ret)
 	goto out;
 
-    rc = ldap_search_ext_s(HDB2LDAP(db), dn, LDAP_SCOPE_SUBTREE,
-			   filter, krb5principal_attrs, 0,
-			   NULL, NULL, NULL,
-			   0, &res);
+    rc = LDAP__search(context, db, dn, filter, krb5principal_attrs, &res);
     if (check_ldap(context, db, rc)) {
 	ret = HDB_ERR_NOENTRY;
 	krb5_set_error_message(context, ret, "ldap_search_ext_s: "
@@ -834,6 +848,104 @@ escape_value(krb5_context context, const char *unquoted, char **quoted)
 }
 
 
+/*
+ * ldap_search_ext_s() that reconnects and tries again once if the
+ * server went away, as a kept connection may have been dropped.
+ */
+static int
+LDAP__search(krb5_context context, HDB *db, const char *base,
+	     const char *filter, char **attrs, LDAPMessage **res)
+{
+    int rc;
+
+    rc = ldap_search_ext_s(HDB2LDAP(db), base, LDAP_SCOPE_SUBTREE,
+			   filter, attrs, 0, NULL, NULL, NULL, 0, res);
+    if (rc != LDAP_SERVER_DOWN)
+	return rc;
+
+    if (*res) {
+	ldap_msgfree(*res);
+	*res = NULL;
+    }
+    LDAP__disconnect(context, db);
+    if (LDAP__connect(context, db) != 0 ||
+	LDAP_no_size_limit(context, HDB2LDAP(db)) != 0)
+	return rc;
+    return ldap_search_ext_s(HDB2LDAP(db), base, LDAP_SCOPE_SUBTREE,
+			     filter, attrs, 0, NULL, NULL, NULL, 0, res);
+}
+
+static void
+LDAP_cache_flush(krb5_context context, HDB *db)
+{
+    struct hdbldapdb *h = db->hdb_db;
+    size_t i;
+
+    for (i = 0; i < HDB_LDAP_CACHE_SIZE; i++) {
+	struct ldap_cache_entry *c = &h->h_cache[i];
+
+	if (c->name == NULL)
+	    continue;
+	free(c->name);
+	c->name = NULL;
+	hdb_free_entry(context, &c->entry);
+    }
+}
+
+/*
+ * Expired entries are freed as they are passed over, so they don't
+ * linger until their slot is reused.
+ */
+static struct ldap_cache_entry *
+LDAP_cache_find(krb5_context context, HDB *db, const char *name,
+		unsigned flags)
+{
+    struct hdbldapdb *h = db->hdb_db;
+    struct ldap_cache_entry *found = NULL;
+    time_t now = time(NULL);
+    size_t i;
+
+    for (i = 0; i < HDB_LDAP_CACHE_SIZE; i++) {
+	struct ldap_cache_entry *c = &h->h_cache[i];
+
+	if (c->name == NULL)
+	    continue;
+	if (c->expires <= now) {
+	    free(c->name);
+	    c->name = NULL;
+	    hdb_free_entry(context, &c->entry);
+	} else if (found == NULL && c->flags == flags &&
+		   strcmp(c->name, name) == 0)
+	    found = c;
+    }
+    return found;
+}
+
+static void
+LDAP_cache_add(krb5_context context, HDB *db, const char *name,
+	       unsigned flags, const hdb_entry *entry)
+{
+    struct hdbldapdb *h = db->hdb_db;
+    struct ldap_cache_entry *c;
+
+    c = &h->h_cache[h->h_cache_next++ % HDB_LDAP_CACHE_SIZE];
+    if (c->name) {
+	free(c->name);
+	c->name = NULL;
+	hdb_free_entry(context, &c->entry);
+    }
+    memset(&c->entry, 0, sizeof(c->entry));
+    if (copy_hdb_entry(entry, &c->entry.entry))
+	return;
+    c->name = strdup(name);
+    if (c->name == NULL) {
+	hdb_free_entry(context, &c->entry);
+	return;
+    }
+    c->flags = flags;
+    c->expires = time(NULL) + h->h_cache_ttl;
+}
+
 static krb5_error_code
 LDAP__lookup_princ(krb5_context context,
 		   HDB *db,
@@ -873,11 +985,8 @@ LDAP__lookup_princ(krb5_context context,
     if (ret)
 	goto out;
 
-    rc = ldap_search_ext_s(HDB2LDAP(db), HDB2BASE(db),
-			   LDAP_SCOPE_SUBTREE, filter,
-			   krb5kdcentry_attrs, 0,
-			   NULL, NULL, NULL,
-			   0, msg);
+    rc = LDAP__search(context, db, HDB2BASE(db), filter,
+		      krb5kdcentry_attrs, msg);
     if (check_ldap(context, db, rc)) {
 	ret = HDB_ERR_NOENTRY;
 	krb5_set_error_message(context, ret, "ldap_search_ext_s: "
@@ -910,10 +1019,8 @@ LDAP__lookup_princ(krb5_context context,
 	if (ret)
 	    goto out;
 
-	rc = ldap_search_ext_s(HDB2LDAP(db), HDB2BASE(db), LDAP_SCOPE_SUBTREE,
-			       filter, krb5kdcentry_attrs, 0,
-			       NULL, NULL, NULL,
-			       0, msg);
+	rc = LDAP__search(context, db, HDB2BASE(db), filter,
+			  krb5kdcentry_attrs, msg);
 	if (check_ldap(context, db, rc)) {
 	    ret = HDB_ERR_NOENTRY;
 	    krb5_set_error_message(context, ret,
@@ -1410,7 +1517,7 @@ out:
 }
 
 static krb5_error_code
-LDAP_close(krb5_context context, HDB * db)
+LDAP__disconnect(krb5_context context, HDB * db)
 {
     if (HDB2LDAP(db)) {
 	ldap_unbind_ext(HDB2LDAP(db), NULL, NULL);
@@ -1420,6 +1527,24 @@ LDAP_close(krb5_context context, HDB * db)
     return 0;
 }
 
+/*
+ * The KDC opens and closes the database around every lookup, so
+ * unless hdb-ldap-keep-open is false the bound connection is kept for
+ * the next open; LDAP__connect() checks that it is still alive.
+ */
+static krb5_error_code
+LDAP_close(krb5_context context, HDB * db)
+{
+    struct hdbldapdb *h = db->hdb_db;
+
+    if (!h->h_keep)
+	return LDAP__disconnect(context, db);
+    if (h->h_lp && h->h_msgid > 0)
+	ldap_abandon_ext(h->h_lp, h->h_msgid, NULL, NULL);
+    h->h_msgid = -1;
+    return 0;
+}
+
 static krb5_error_code
 LDAP_lock(krb5_context context, HDB * db, int operation)
 {
@@ -1471,7 +1596,7 @@ LDAP_seq(krb5_context context, HDB * db, unsigned flags, hdb_entry_ex * entry)
 	    break;
 	case LDAP_SERVER_DOWN:
 	    ldap_msgfree(e);
-	    LDAP_close(context, db);
+	    LDAP__disconnect(context, db);
 	    HDBSETMSGID(db, -1);
 	    ret = ENETDOWN;
 	    break;
@@ -1562,7 +1687,7 @@ LDAP__connect(krb5_context context, HDB * db)
 	if (ldap_get_option(HDB2LDAP(db), LDAP_OPT_DESC, &sd) == 0 &&
 	    getpeername(sd, (struct sockaddr *) &addr, &len) < 0) {
 	    /* the other end has died. reopen. */
-	    LDAP_close(context, db);
+	    LDAP__disconnect(context, db);
 	}
     }
 
@@ -1581,7 +1706,7 @@ LDAP__connect(krb5_context context, HDB * db)
     if (rc != LDAP_SUCCESS) {
 	krb5_set_error_message(context, HDB_ERR_BADVERSION,
 			       "ldap_set_option: %s", ldap_err2string(rc));
-	LDAP_close(context, db);
+	LDAP__disconnect(context, db);
 	return HDB_ERR_BADVERSION;
     }
 
@@ -1591,7 +1716,7 @@ LDAP__connect(krb5_context context, HDB * db)
 	if (rc != LDAP_SUCCESS) {
 	    krb5_set_error_message(context, HDB_ERR_BADVERSION,
 				   "ldap_start_tls_s: %s", ldap_err2string(rc));
-	    LDAP_close(context, db);
+	    LDAP__disconnect(context, db);
 	    return HDB_ERR_BADVERSION;
 	}
     }
@@ -1601,7 +1726,7 @@ LDAP__connect(krb5_context context, HDB * db)
     if (rc != LDAP_SUCCESS) {
 	krb5_set_error_message(context, HDB_ERR_BADVERSION,
 			      "ldap_sasl_bind_s: %s", ldap_err2string(rc));
-	LDAP_close(context, db);
+	LDAP__disconnect(context, db);
 	return HDB_ERR_BADVERSION;
     }
 
@@ -1627,16 +1752,50 @@ LDAP_open(krb5_context context, HDB * db, int flags, mode_t mode)
     return LDAP__connect(context, db);
 }
 
+static krb5_error_code
+LDAP_unseal_keys(krb5_context context, HDB *db, unsigned flags,
+		 hdb_entry_ex *entry)
+{
+    krb5_error_code ret;
+
+    if (!db->hdb_master_key_set || (flags & HDB_F_DECRYPT) == 0)
+	return 0;
+    ret = hdb_unseal_keys(context, db, &entry->entry);
+    if (ret)
+	hdb_free_entry(context, entry);
+    return ret;
+}
+
 static krb5_error_code
 LDAP_fetch_kvno(krb5_context context, HDB * db, krb5_const_principal principal,
 		unsigned flags, krb5_kvno kvno, hdb_entry_ex * entry)
 {
+    struct hdbldapdb *h = db->hdb_db;
+    struct ldap_cache_entry *c;
     LDAPMessage *msg, *e;
     krb5_error_code ret;
+    char *name = NULL;
+
+    if (h->h_cache_ttl > 0) {
+	ret = krb5_unparse_name(context, principal, &name);
+	if (ret)
+	    return ret;
+	c = LDAP_cache_find(context, db, name, flags);
+	if (c) {
+	    free(name);
+	    memset(entry, 0, sizeof(*entry));
+	    ret = copy_hdb_entry(&c->entry.entry, &entry->entry);
+	    if (ret)
+		return ret;
+	    return LDAP_unseal_keys(context, db, flags, entry);
+	}
+    }
 
     ret = LDAP_principal2message(context, db, principal, &msg);
-    if (ret)
+    if (ret) {
+	free(name);
 	return ret;
+    }
 
     e = ldap_first_entry(HDB2LDAP(db), msg);
     if (e == NULL) {
@@ -1646,15 +1805,15 @@ LDAP_fetch_kvno(krb5_context context, HDB * db, krb5_const_principal principal,
 
     ret = LDAP_message2entry(context, db, e, flags, entry);
     if (ret == 0) {
-	if (db->hdb_master_key_set && (flags & HDB_F_DECRYPT)) {
-	    ret = hdb_unseal_keys(context, db, &entry->entry);
-	    if (ret)
-		hdb_free_entry(context, entry);
-	}
+	/* the cache only holds keys as sealed in the directory */
+	if (name)
+	    LDAP_cache_add(context, db, name, flags, &entry->entry);
+	ret = LDAP_unseal_keys(context, db, flags, entry);
     }
 
   out:
     ldap_msgfree(msg);
+    free(name);
 
     return ret;
 }
@@ -1678,6 +1837,8 @@ LDAP_store(krb5_context context, HDB * db, unsigned flags,
     LDAPMessage *msg = NULL, *e = NULL;
     char *dn = NULL, *name = NULL;
 
+    LDAP_cache_flush(context, db);
+
     ret = LDAP_principal2message(context, db, entry->entry.principal, &msg);
     if (ret == 0)
 	e = ldap_first_entry(HDB2LDAP(db), msg);
@@ -1756,6 +1917,8 @@ LDAP_remove(krb5_context context, HDB *db, krb5_const_principal principal)
     char *dn = NULL;
     int rc, limit = LDAP_NO_LIMIT;
 
+    LDAP_cache_flush(context, db);
+
     ret = LDAP_principal2message(context, db, principal, &msg);
     if (ret)
 	goto out;
@@ -1802,7 +1965,8 @@ LDAP_destroy(krb5_context context, HDB * db)
 {
     krb5_error_code ret;
 
-    LDAP_close(context, db);
+    LDAP__disconnect(context, db);
+    LDAP_cache_flush(context, db);
 
     ret = hdb_clear_master_key(context, db);
     if (HDB2BASE(db))
@@ -1923,6 +2087,13 @@ hdb_ldap_common(krb5_context context,
 	krb5_config_get_bool_default(context, NULL, FALSE,
 				     "kdc", "hdb-ldap-start-tls", NULL);
 
+    h->h_keep =
+	krb5_config_get_bool_default(context, NULL, TRUE,
+				     "kdc", "hdb-ldap-keep-open", NULL);
+    h->h_cache_ttl =
+	krb5_config_get_time_default(context, NULL, 0,
+				     "kdc", "hdb-ldap-cache-ttl", NULL);
+
     create_base = krb5_config_get_string(context, NULL, "kdc",
 					 "hdb-ldap-create-base", NULL);
     if (create_base == NULL)
@@ -47,19 +47,82 @@ typedef struct mdb_info {
     MDB_txn *t;
     MDB_dbi d;
     MDB_cursor *c;
+    MDB_txn *bulk;		/* write txn shared by a bulk load */
+    unsigned bulk_count;	/* puts in `bulk' since its last commit */
+    unsigned bulk_batch;
+    int bulk_append;		/* keys arrive sorted, try MDB_APPEND */
+    int bulk_error;		/* `bulk' was lost to a hard error */
+    unsigned shard;		/* walk only keys in this shard ... */
+    unsigned nshards;		/* ... of this many (0 or 1: all) */
+    MDB_txn *rtxn;		/* reset read txn, renewed by DB__get */
+    int keep;			/* keep `e' open across read-only closes */
+    dev_t dev;			/* file `e' was opened on */
+    ino_t ino;
 } mdb_info;
 
+/*
+ * Drop the bulk transaction after an error that leaves it unusable.
+ * The caller sees the error on this store and on hdb_end_bulk().
+ */
+static void
+bulk_abort(mdb_info *mi, int code)
+{
+    mdb_txn_abort(mi->bulk);
+    mi->bulk = NULL;
+    mi->bulk_error = code;
+}
+
+/*
+ * Another process may have grown the map since the environment was
+ * opened, which matters now that read-only environments are kept
+ * open; adopt the new size and try again.  The map can't be moved
+ * under an iteration in progress.
+ */
+static int
+txn_begin(mdb_info *mi, unsigned int flags, MDB_txn **txn)
+{
+    int code;
+
+    code = mdb_txn_begin(mi->e, NULL, flags, txn);
+    if (code == MDB_MAP_RESIZED && mi->t == NULL) {
+	code = mdb_env_set_mapsize(mi->e, 0);
+	if (code == 0)
+	    code = mdb_txn_begin(mi->e, NULL, flags, txn);
+    }
+    return code;
+}
+
+static void
+env_close(mdb_info *mi)
+{
+    if (mi->rtxn)
+	mdb_txn_abort(mi->rtxn);
+    if (mi->e)
+	mdb_env_close(mi->e);
+    mi->rtxn = 0;
+    mi->e = 0;
+    mi->keep = 0;
+}
+
+/*
+ * The KDC opens and closes the database around every lookup.  For a
+ * read-only handle the environment (and its mmap) is kept and reused
+ * by the next read-only open, unless the file has been replaced.
+ */
 static krb5_error_code
 DB_close(krb5_context context, HDB *db)
 {
     mdb_info *mi = (mdb_info *)db->hdb_db;
 
+    if (mi->bulk)
+	mdb_txn_abort(mi->bulk);
+    mi->bulk = NULL;
     mdb_cursor_close(mi->c);
     mdb_txn_abort(mi->t);
-    mdb_env_close(mi->e);
     mi->c = 0;
     mi->t = 0;
-    mi->e = 0;
+    if (!mi->keep)
+	env_close(mi);
     return 0;
 }
 
@@ -68,6 +131,7 @@ DB_destroy(krb5_context context, HDB *db)
 {
     krb5_error_code ret;
 
+    env_close(db->hdb_db);
     ret = hdb_clear_master_key (context, db);
     free(db->hdb_name);
     free(db->hdb_db);
@@ -104,6 +168,7 @@ DB_seq(krb5_context context, HDB *db,
     krb5_data key_data, data;
     int code;
 
+again:
     key.mv_size = 0;
     value.mv_size = 0;
     code = mdb_cursor_get(mi->c, &key, &value, flag);
@@ -114,6 +179,10 @@ DB_seq(krb5_context context, HDB *db,
 
     key_data.data = key.mv_data;
     key_data.length = key.mv_size;
+    if (mi->nshards > 1 && _hdb_key2shard(&key_data, mi->nshards) != mi->shard) {
+	flag = MDB_NEXT;
+	goto again;
+    }
     data.data = value.mv_data;
     data.length = value.mv_size;
     memset(entry, 0, sizeof(*entry));
@@ -147,8 +216,9 @@ DB_firstkey(krb5_context context, HDB *db, unsigned flags, hdb_entry_ex *entry)
     /* Always start with a fresh cursor to pick up latest DB state */
     if (mi->t)
 	mdb_txn_abort(mi->t);
+    mi->t = NULL;
 
-    code = mdb_txn_begin(mi->e, NULL, MDB_RDONLY, &mi->t);
+    code = txn_begin(mi, MDB_RDONLY, &mi->t);
     if (code)
 	return code;
 
@@ -160,6 +230,73 @@ DB_firstkey(krb5_context context, HDB *db, unsigned flags, hdb_entry_ex *entry)
 }
 
 
+/*
+ * Only the keys (encoded principal names) are decoded; aliases, whose
+ * values are [APPLICATION 0] rather than a SEQUENCE, and the format
+ * record are skipped.
+ */
+static krb5_error_code
+DB_list_names(krb5_context context, HDB *db, const char *prefix,
+	      hdb_name_func_t func, void *data)
+{
+    mdb_info *mi = db->hdb_db;
+    size_t len = strlen(prefix);
+    MDB_txn *txn = mi->bulk;
+    MDB_cursor *c;
+    MDB_val key, value;
+    krb5_data key_data;
+    Principal principal;
+    char *name;
+    int code;
+
+    if (txn == NULL) {
+	code = txn_begin(mi, MDB_RDONLY, &txn);
+	if (code)
+	    return code;
+    }
+    code = mdb_cursor_open(txn, mi->d, &c);
+    if (code)
+	goto out;
+
+    for (code = mdb_cursor_get(c, &key, &value, MDB_FIRST);
+	 code == 0;
+	 code = mdb_cursor_get(c, &key, &value, MDB_NEXT)) {
+	if (value.mv_size == 0 || *(unsigned char *)value.mv_data != 0x30)
+	    continue;
+	key_data.data = key.mv_data;
+	key_data.length = key.mv_size;
+	if (hdb_key2principal(context, &key_data, &principal))
+	    continue;
+	code = krb5_unparse_name(context, &principal, &name);
+	free_Principal(&principal);
+	if (code)
+	    break;
+	if (strncmp(name, prefix, len) == 0)
+	    code = (*func)(context, db, name, data);
+	free(name);
+	if (code)
+	    break;
+    }
+    if (code == MDB_NOTFOUND)
+	code = 0;
+    mdb_cursor_close(c);
+
+out:
+    if (txn != mi->bulk)
+	mdb_txn_abort(txn);
+    return code;
+}
+
+static krb5_error_code
+DB_set_shard(krb5_context context, HDB *db, unsigned shard, unsigned nshards)
+{
+    mdb_info *mi = db->hdb_db;
+
+    mi->shard = shard;
+    mi->nshards = nshards;
+    return 0;
+}
+
 static krb5_error_code
 DB_nextkey(krb5_context context, HDB *db, unsigned flags, hdb_entry_ex *entry)
 {
@@ -193,26 +330,83 @@ static krb5_error_code
 DB__get(krb5_context context, HDB *db, krb5_data key, krb5_data *reply)
 {
     mdb_info *mi = (mdb_info*)db->hdb_db;
-    MDB_txn *txn;
     MDB_val k, v;
     int code;
 
     k.mv_data = key.data;
     k.mv_size = key.length;
 
-    code = mdb_txn_begin(mi->e, NULL, MDB_RDONLY, &txn);
+    /* Inside a bulk load, see what has been put but not committed */
+    if (mi->bulk) {
+	code = mdb_get(mi->bulk, mi->d, &k, &v);
+	if (code == 0)
+	    krb5_data_copy(reply, v.mv_data, v.mv_size);
+	if (code == MDB_NOTFOUND)
+	    return HDB_ERR_NOENTRY;
+	return code;
+    }
+
+    /* Reuse one read txn; renew takes a fresh snapshot */
+    if (mi->rtxn == NULL)
+	code = txn_begin(mi, MDB_RDONLY, &mi->rtxn);
+    else {
+	code = mdb_txn_renew(mi->rtxn);
+	if (code == MDB_MAP_RESIZED) {
+	    mdb_txn_abort(mi->rtxn);
+	    mi->rtxn = NULL;
+	    code = txn_begin(mi, MDB_RDONLY, &mi->rtxn);
+	}
+    }
     if (code)
 	return code;
 
-    code = mdb_get(txn, mi->d, &k, &v);
+    code = mdb_get(mi->rtxn, mi->d, &k, &v);
     if (code == 0)
 	krb5_data_copy(reply, v.mv_data, v.mv_size);
-    mdb_txn_abort(txn);
+    mdb_txn_reset(mi->rtxn);
     if(code == MDB_NOTFOUND)
 	return HDB_ERR_NOENTRY;
     return code;
 }
 
+/*
+ * Put into the bulk transaction, committing it every `bulk_batch'
+ * puts.  Dumps taken from another LMDB (or written in key order) can
+ * be appended to the end of the tree without searching it; the first
+ * out-of-order key turns that off for the rest of the load.
+ */
+static int
+bulk_put(mdb_info *mi, int replace, MDB_val *k, MDB_val *v)
+{
+    unsigned flags = replace ? 0 : MDB_NOOVERWRITE;
+    int code = MDB_KEYEXIST;
+
+    if (mi->bulk_append) {
+	code = mdb_put(mi->bulk, mi->d, k, v, flags | MDB_APPEND);
+	if (code == MDB_KEYEXIST)
+	    mi->bulk_append = 0;
+    }
+    if (code == MDB_KEYEXIST)
+	code = mdb_put(mi->bulk, mi->d, k, v, flags);
+    if (code == MDB_KEYEXIST)
+	return HDB_ERR_EXISTS;
+    if (code) {
+	bulk_abort(mi, code);
+	return code;
+    }
+
+    if (++mi->bulk_count < mi->bulk_batch)
+	return 0;
+    mi->bulk_count = 0;
+    code = mdb_txn_commit(mi->bulk);
+    mi->bulk = NULL;
+    if (code == 0)
+	code = txn_begin(mi, 0, &mi->bulk);
+    if (code)
+	mi->bulk_error = code;
+    return code;
+}
+
 static krb5_error_code
 DB__put(krb5_context context, HDB *db, int replace,
 	krb5_data key, krb5_data value)
@@ -227,7 +421,12 @@ DB__put(krb5_context context, HDB *db, int replace,
     v.mv_data = value.data;
     v.mv_size = value.length;
 
-    code = mdb_txn_begin(mi->e, NULL, 0, &txn);
+    if (mi->bulk)
+	return bulk_put(mi, replace, &k, &v);
+    if (mi->bulk_error)
+	return mi->bulk_error;
+
+    code = txn_begin(mi, 0, &txn);
     if (code)
 	return code;
 
@@ -252,7 +451,18 @@ DB__del(krb5_context context, HDB *db, krb5_data key)
     k.mv_data = key.data;
     k.mv_size = key.length;
 
-    code = mdb_txn_begin(mi->e, NULL, 0, &txn);
+    if (mi->bulk) {
+	code = mdb_del(mi->bulk, mi->d, &k, NULL);
+	if (code == MDB_NOTFOUND)
+	    return HDB_ERR_NOENTRY;
+	if (code)
+	    bulk_abort(mi, code);
+	return code;
+    }
+    if (mi->bulk_error)
+	return mi->bulk_error;
+
+    code = txn_begin(mi, 0, &txn);
     if (code)
 	return code;
 
@@ -266,6 +476,47 @@ DB__del(krb5_context context, HDB *db, krb5_data key)
     return code;
 }
 
+static krb5_error_code
+DB_begin_bulk(krb5_context context, HDB *db)
+{
+    mdb_info *mi = (mdb_info *)db->hdb_db;
+    int code;
+
+    if (mi->bulk)
+	return 0;
+    code = txn_begin(mi, 0, &mi->bulk);
+    if (code) {
+	krb5_set_error_message(context, code, "bulk load of %s: %s",
+			       db->hdb_name, mdb_strerror(code));
+	return code;
+    }
+    mi->bulk_count = 0;
+    mi->bulk_batch = _hdb_bulk_batch_size(context);
+    mi->bulk_append = 1;
+    mi->bulk_error = 0;
+    return 0;
+}
+
+static krb5_error_code
+DB_end_bulk(krb5_context context, HDB *db, int commit)
+{
+    mdb_info *mi = (mdb_info *)db->hdb_db;
+    int code = mi->bulk_error;
+
+    if (mi->bulk) {
+	if (commit && code == 0)
+	    code = mdb_txn_commit(mi->bulk);
+	else
+	    mdb_txn_abort(mi->bulk);
+	mi->bulk = NULL;
+    }
+    mi->bulk_error = 0;
+    if (code && commit)
+	krb5_set_error_message(context, code, "bulk load of %s: %s",
+			       db->hdb_name, mdb_strerror(code));
+    return commit ? code : 0;
+}
+
 static krb5_error_code
 DB_open(krb5_context context, HDB *db, int flags, mode_t mode)
 {
@@ -274,7 +525,16 @@ DB_open(krb5_context context, HDB *db, int flags, mode_t mode)
     char *fn;
     krb5_error_code ret;
     int myflags = MDB_NOSUBDIR, tmp;
-
+    struct stat st;
+
+    /*
+     * NOTLS ties reader slots to transactions rather than threads, so
+     * the reset read txn can coexist with DB_firstkey()'s and be used
+     * from whichever thread holds the handle.
+     */
+#ifdef MDB_NOTLS
+    myflags |= MDB_NOTLS;
+#endif
     if((flags & O_ACCMODE) == O_RDONLY)
       myflags |= MDB_RDONLY;
 
@@ -282,6 +542,14 @@ DB_open(krb5_context context, HDB *db, int flags, mode_t mode)
 	krb5_set_error_message(context, ENOMEM, "malloc: out of memory");
 	return ENOMEM;
     }
+    if (mi->e) {
+	if (mi->keep && (myflags & MDB_RDONLY) && stat(fn, &st) == 0 &&
+	    st.st_dev == mi->dev && st.st_ino == mi->ino) {
+	    free(fn);
+	    return 0;
+	}
+	env_close(mi);
+    }
     if (mdb_env_create(&mi->e)) {
 	free(fn);
 	krb5_set_error_message(context, ENOMEM, "malloc: out of memory");
@@ -317,12 +585,21 @@ DB_open(krb5_context context, HDB *db, int flags, mode_t mode)
 fail:
 	mdb_env_close(mi->e);
 	mi->e = 0;
+	mi->keep = 0;
 	free(fn);
 	krb5_set_error_message(context, ret, "opening %s: %s",
 			      db->hdb_name, mdb_strerror(ret));
 	return ret;
     }
+    if ((myflags & MDB_RDONLY) && stat(fn, &st) == 0 &&
+	krb5_config_get_bool_default(context, NULL, TRUE, "kdc",
+				     "hdb-mdb-keep-open", NULL)) {
+	mi->dev = st.st_dev;
+	mi->ino = st.st_ino;
+	mi->keep = 1;
+    }
     free(fn);
+    fn = NULL;
 
     ret = mdb_txn_begin(mi->e, NULL, MDB_RDONLY, &txn);
     if (ret)
@@ -341,6 +618,7 @@ fail:
 	return 0;
     if (ret) {
 	DB_close(context, db);
+	env_close(mi);
 	krb5_set_error_message(context, ret, "hdb_open: failed %s database %s",
 			       (flags & O_ACCMODE) == O_RDONLY ?
 			       "checking format of" : "initialize",
@@ -392,6 +670,10 @@ hdb_mdb_create(krb5_context context, HDB **db,
     (*db)->hdb__put = DB__put;
     (*db)->hdb__del = DB__del;
     (*db)->hdb_destroy = DB_destroy;
+    (*db)->hdb_begin_bulk = DB_begin_bulk;
+    (*db)->hdb_end_bulk = DB_end_bulk;
+    (*db)->hdb_set_shard = DB_set_shard;
+    (*db)->hdb_list_names = DB_list_names;
     return 0;
 }
 #endif /* HAVE_MDB */
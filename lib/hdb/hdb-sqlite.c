@@ -33,6 +33,8 @@
 
 #include "hdb_locl.h"
 #include "sqlite3.h"
+#include <parse_bytes.h>
+#include <ctype.h>
 
 #define MAX_RETRIES 10
 
@@ -51,6 +53,11 @@ typedef struct hdb_sqlite_db {
     sqlite3_stmt *update_entry;
     sqlite3_stmt *remove;
     sqlite3_stmt *get_all_entries;
+    sqlite3_stmt *list_names;
+
+    int bulk;			/* inside hdb_begin_bulk() */
+    unsigned bulk_count;	/* stores since the last COMMIT */
+    unsigned bulk_batch;
 
 } hdb_sqlite_db;
 
@@ -109,8 +116,13 @@ typedef struct hdb_sqlite_db {
                  " DELETE FROM ENTRY WHERE id = " \
                  "  (SELECT entry FROM Principal" \
                  "   WHERE principal = ?)"
+#define HDBSQLITE_LIST_NAMES \
+                 " SELECT principal FROM Principal" \
+                 " WHERE principal >= ? AND canonical = 1" \
+                 " ORDER BY principal"
 #define HDBSQLITE_GET_ALL_ENTRIES \
-                 " SELECT data FROM Entry"
+                 " SELECT data FROM Entry" \
+                 " WHERE id % ?1 = ?2"
 
 /**
  * Wrapper around sqlite3_prepare_v2.
@@ -207,6 +219,136 @@ bind_principal(krb5_context context, krb5_const_principal principal, sqlite3_stm
     return 0;
 }
 
+/*
+ * parse_bytes() computes in an int, which overflows at 2GiB.  Parse a
+ * number and an optional unit here and leave only the unit to
+ * parse_bytes(); anything else, like "1 MB 512 KB", still goes to
+ * parse_bytes().
+ */
+static int
+parse_size(const char *s, int64_t *size)
+{
+    const int64_t max = (int64_t)(~(uint64_t)0 >> 1);
+    char *end, *unit;
+    long long val;
+    int mult = 1;
+
+    errno = 0;
+    val = strtoll(s, &end, 0);
+    if (end != s && val >= 0 && errno == 0) {
+        while (isspace((unsigned char)*end))
+            end++;
+        if (*end != '\0') {
+            if (asprintf(&unit, "1 %s", end) < 0 || unit == NULL)
+                return ENOMEM;
+            mult = parse_bytes(unit, NULL);
+            free(unit);
+        }
+        if (mult > 0) {
+            if (val > max / mult)
+                return ERANGE;
+            *size = (int64_t)val * mult;
+            return 0;
+        }
+    }
+    mult = parse_bytes(s, NULL);
+    if (mult < 0)
+        return EINVAL;
+    *size = mult;
+    return 0;
+}
+
+/**
+ * Applies the `[kdc] hdb-sqlite-*' tuning options to a freshly opened
+ * database connection.
+ *
+ * In WAL mode readers do not block the writer (and vice versa), so a
+ * KDC can keep serving requests while kadmind or ipropd-slave write.
+ *
+ * @param context The current krb5_context
+ * @param db      Heimdal database handle
+ *
+ * @return        0 if OK, else error_code
+ */
+static krb5_error_code
+hdb_sqlite_tune(krb5_context context, HDB *db)
+{
+    static const char *journal_modes[] = {
+        "delete", "truncate", "persist", "memory", "wal", "off", NULL
+    };
+    hdb_sqlite_db *hsdb = (hdb_sqlite_db*) db->hdb_db;
+    krb5_error_code ret;
+    const char *s;
+    char *stmt;
+    size_t i;
+    int64_t n;
+
+    s = krb5_config_get_string(context, NULL, "kdc",
+                               "hdb-sqlite-journal-mode", NULL);
+    if (s) {
+        for (i = 0; journal_modes[i]; i++)
+            if (strcasecmp(s, journal_modes[i]) == 0)
+                break;
+        if (journal_modes[i] == NULL) {
+            krb5_set_error_message(context, EINVAL,
+                                   "Unknown hdb-sqlite-journal-mode %s", s);
+            return EINVAL;
+        }
+        if (asprintf(&stmt, "PRAGMA journal_mode=%s", journal_modes[i]) < 0 ||
+            stmt == NULL)
+            return krb5_enomem(context);
+        ret = hdb_sqlite_exec_stmt(context, hsdb->db, stmt, EINVAL);
+        free(stmt);
+        if (ret)
+            return ret;
+        /* Safe with WAL; only the last commits may be lost on power loss */
+        if (strcmp(journal_modes[i], "wal") == 0) {
+            ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+                                       "PRAGMA synchronous=NORMAL", EINVAL);
+            if (ret)
+                return ret;
+        }
+    }
+
+    s = krb5_config_get_string(context, NULL, "kdc",
+                               "hdb-sqlite-mmap-size", NULL);
+    if (s) {
+        if (parse_size(s, &n) != 0) {
+            krb5_set_error_message(context, EINVAL,
+                                   "Invalid hdb-sqlite-mmap-size %s", s);
+            return EINVAL;
+        }
+        if (asprintf(&stmt, "PRAGMA mmap_size=%lld", (long long)n) < 0 ||
+            stmt == NULL)
+            return krb5_enomem(context);
+        ret = hdb_sqlite_exec_stmt(context, hsdb->db, stmt, EINVAL);
+        free(stmt);
+        if (ret)
+            return ret;
+    }
+
+    s = krb5_config_get_string(context, NULL, "kdc",
+                               "hdb-sqlite-cache-size", NULL);
+    if (s) {
+        if (parse_size(s, &n) != 0) {
+            krb5_set_error_message(context, EINVAL,
+                                   "Invalid hdb-sqlite-cache-size %s", s);
+            return EINVAL;
+        }
+        /* A negative cache_size is in KiB rather than pages */
+        if (asprintf(&stmt, "PRAGMA cache_size=-%lld",
+                     (long long)(n / 1024 + (n % 1024 != 0))) < 0 ||
+            stmt == NULL)
+            return krb5_enomem(context);
+        ret = hdb_sqlite_exec_stmt(context, hsdb->db, stmt, EINVAL);
+        free(stmt);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
 /**
  * Opens an sqlite3 database handle to a file, may create the
  * database file depending on flags.
@@ -238,6 +380,13 @@ hdb_sqlite_open_database(krb5_context context, HDB *db, int flags)
         return ret;
     }
 
+    ret = hdb_sqlite_tune(context, db);
+    if (ret) {
+        sqlite3_close(hsdb->db);
+        hsdb->db = NULL;
+        return ret;
+    }
+
     return 0;
 }
 
@@ -278,6 +427,7 @@ hdb_sqlite_close_database(krb5_context context, HDB *db)
     sqlite3_finalize(hsdb->update_entry);
     sqlite3_finalize(hsdb->remove);
     sqlite3_finalize(hsdb->get_all_entries);
+    sqlite3_finalize(hsdb->list_names);
 
     sqlite3_close(hsdb->db);
 
@@ -363,6 +513,13 @@ hdb_sqlite_make_database(krb5_context context, HDB *db, const char *filename)
                                   &hsdb->get_all_entries,
                                   HDBSQLITE_GET_ALL_ENTRIES);
     if (ret) goto out;
+    ret = hdb_sqlite_prepare_stmt(context, hsdb->db,
+                                  &hsdb->list_names,
+                                  HDBSQLITE_LIST_NAMES);
+    if (ret) goto out;
+    /* No sharding: every id is 0 modulo 1 */
+    sqlite3_bind_int64(hsdb->get_all_entries, 1, 1);
+    sqlite3_bind_int64(hsdb->get_all_entries, 2, 0);
 
     ret = hdb_sqlite_step(context, hsdb->db, hsdb->get_version);
     if(ret == SQLITE_ROW) {
@@ -521,7 +678,13 @@ hdb_sqlite_store(krb5_context context, HDB *db, unsigned flags,
     krb5_data value;
     sqlite3_stmt *get_ids = hsdb->get_ids;
 
+    /*
+     * During a bulk load the outer transaction is already open; a
+     * savepoint lets a failed store be undone without losing the
+     * rest of the batch.
+     */
     ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+                               hsdb->bulk ? "SAVEPOINT hdb_store" :
                                "BEGIN IMMEDIATE TRANSACTION", EINVAL);
     if(ret != SQLITE_OK) {
 	ret = EINVAL;
@@ -619,7 +782,31 @@ commit:
     sqlite3_clear_bindings(get_ids);
     sqlite3_reset(get_ids);
 
-    ret = hdb_sqlite_exec_stmt(context, hsdb->db, "COMMIT", EINVAL);
+    if (hsdb->bulk) {
+	ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+				   "RELEASE hdb_store", EINVAL);
+	if (ret == 0 && ++hsdb->bulk_count >= hsdb->bulk_batch) {
+	    hsdb->bulk_count = 0;
+	    /*
+	     * Separate statements, hdb_sqlite_exec_stmt() reruns the
+	     * whole string when the database is busy.
+	     */
+	    ret = hdb_sqlite_exec_stmt(context, hsdb->db, "COMMIT", EINVAL);
+	    if (ret == 0) {
+		ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+					   "BEGIN IMMEDIATE TRANSACTION",
+					   EINVAL);
+		if (ret) {
+		    /* the batch is committed but there is no transaction */
+		    hsdb->bulk = 0;
+		    krb5_warnx(context, "hdb-sqlite: BEGIN problem: %d: %s",
+			       ret, sqlite3_errmsg(hsdb->db));
+		    return ret;
+		}
+	    }
+	}
+    } else
+	ret = hdb_sqlite_exec_stmt(context, hsdb->db, "COMMIT", EINVAL);
     if(ret != SQLITE_OK)
 	krb5_warnx(context, "hdb-sqlite: COMMIT problem: %d: %s",
 		   ret, sqlite3_errmsg(hsdb->db));
@@ -631,11 +818,66 @@ rollback:
     krb5_warnx(context, "hdb-sqlite: store rollback problem: %d: %s",
 	       ret, sqlite3_errmsg(hsdb->db));
 
-    ret = hdb_sqlite_exec_stmt(context, hsdb->db,
-                               "ROLLBACK", EINVAL);
+    if (hsdb->bulk) {
+	ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+				   "ROLLBACK TO hdb_store", EINVAL);
+	if (ret == 0)
+	    ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+				       "RELEASE hdb_store", EINVAL);
+    } else
+	ret = hdb_sqlite_exec_stmt(context, hsdb->db, "ROLLBACK", EINVAL);
     return ret;
 }
 
+/**
+ * Starts a bulk load: stores are grouped into transactions of
+ * `[kdc] hdb-bulk-batch-size' entries instead of one each.
+ *
+ * @param context The current krb5 context
+ * @param db      Heimdal database handle
+ *
+ * @return        0 on success, an error code if not
+ */
+static krb5_error_code
+hdb_sqlite_begin_bulk(krb5_context context, HDB *db)
+{
+    hdb_sqlite_db *hsdb = (hdb_sqlite_db *)(db->hdb_db);
+    krb5_error_code ret;
+
+    if (hsdb->bulk)
+	return 0;
+    ret = hdb_sqlite_exec_stmt(context, hsdb->db,
+                               "BEGIN IMMEDIATE TRANSACTION", EINVAL);
+    if (ret)
+	return ret;
+    hsdb->bulk = 1;
+    hsdb->bulk_count = 0;
+    hsdb->bulk_batch = _hdb_bulk_batch_size(context);
+    return 0;
+}
+
+/**
+ * Ends a bulk load, committing or rolling back the stores made since
+ * the last batch was committed.
+ *
+ * @param context The current krb5 context
+ * @param db      Heimdal database handle
+ * @param commit  Non-zero to commit, zero to roll back
+ *
+ * @return        0 on success, an error code if not
+ */
+static krb5_error_code
+hdb_sqlite_end_bulk(krb5_context context, HDB *db, int commit)
+{
+    hdb_sqlite_db *hsdb = (hdb_sqlite_db *)(db->hdb_db);
+
+    if (!hsdb->bulk)
+	return 0;
+    hsdb->bulk = 0;
+    return hdb_sqlite_exec_stmt(context, hsdb->db,
+                                commit ? "COMMIT" : "ROLLBACK", EINVAL);
+}
+
 /**
  * This may be called often by other code, since the BDB backends
  * can not have several open connections. SQLite can handle
@@ -799,6 +1041,73 @@ hdb_sqlite_rename(krb5_context context, HDB *db, const char *new_name)
     return ret;
 }
 
+/**
+ * Lists canonical principal names starting with a prefix, using the
+ * index on Principal.principal to start at the prefix and stopping at
+ * the first name past it.
+ *
+ * @param context The current krb5 context
+ * @param db      Heimdal database handle
+ * @param prefix  Prefix of the names to list, "" for all
+ * @param func    Called with each name
+ * @param data    Passed to func
+ *
+ * @return        0 on success, an error code if not
+ */
+static krb5_error_code
+hdb_sqlite_list_names(krb5_context context, HDB *db, const char *prefix,
+                      hdb_name_func_t func, void *data)
+{
+    hdb_sqlite_db *hsdb = (hdb_sqlite_db *) db->hdb_db;
+    sqlite3_stmt *stmt = hsdb->list_names;
+    size_t len = strlen(prefix);
+    krb5_error_code ret = 0;
+    const char *name;
+    int sqlite_error;
+
+    sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+    while ((sqlite_error = hdb_sqlite_step(context, hsdb->db, stmt)) ==
+           SQLITE_ROW) {
+        name = (const char *)sqlite3_column_text(stmt, 0);
+        if (name == NULL || strncmp(name, prefix, len) != 0)
+            break;
+        ret = (*func)(context, db, name, data);
+        if (ret)
+            break;
+    }
+    if (ret == 0 && sqlite_error != SQLITE_ROW && sqlite_error != SQLITE_DONE) {
+        ret = EINVAL;
+        krb5_set_error_message(context, ret, "sqlite list failed: %s",
+                               sqlite3_errmsg(hsdb->db));
+    }
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+    return ret;
+}
+
+/**
+ * Restricts hdb_sqlite_firstkey()/hdb_sqlite_nextkey() to the entries
+ * whose id is `shard' modulo `nshards'.
+ *
+ * @param context The current krb5 context
+ * @param db      Heimdal database handle
+ * @param shard   The shard to walk
+ * @param nshards The number of shards, 1 for the whole database
+ *
+ * @return        Always returns 0
+ */
+static krb5_error_code
+hdb_sqlite_set_shard(krb5_context context, HDB *db,
+                     unsigned shard, unsigned nshards)
+{
+    hdb_sqlite_db *hsdb = (hdb_sqlite_db *) db->hdb_db;
+
+    sqlite3_reset(hsdb->get_all_entries);
+    sqlite3_bind_int64(hsdb->get_all_entries, 1, nshards ? nshards : 1);
+    sqlite3_bind_int64(hsdb->get_all_entries, 2, shard);
+    return 0;
+}
+
 /*
  * Removes a principal, including aliases and associated entry.
  */
@@ -884,6 +1193,10 @@ hdb_sqlite_create(krb5_context context, HDB **db, const char *argument)
     (*db)->hdb__get = NULL;
     (*db)->hdb__put = NULL;
     (*db)->hdb__del = NULL;
+    (*db)->hdb_begin_bulk = hdb_sqlite_begin_bulk;
+    (*db)->hdb_end_bulk = hdb_sqlite_end_bulk;
+    (*db)->hdb_set_shard = hdb_sqlite_set_shard;
+    (*db)->hdb_list_names = hdb_sqlite_list_names;
 
     return 0;
 }
@@ -232,6 +232,173 @@ hdb_foreach(krb5_context context,
     return ret;
 }
 
+struct list_arg {
+    const char *prefix;
+    size_t len;
+    hdb_name_func_t func;
+    void *data;
+};
+
+static krb5_error_code
+list_filter(krb5_context context, HDB *db, hdb_entry_ex *entry, void *data)
+{
+    struct list_arg *arg = data;
+    krb5_error_code ret;
+    char *name;
+
+    ret = krb5_unparse_name(context, entry->entry.principal, &name);
+    if (ret)
+	return ret;
+    if (strncmp(name, arg->prefix, arg->len) == 0)
+	ret = (*arg->func)(context, db, name, arg->data);
+    free(name);
+    return ret;
+}
+
+/*
+ * Call `func' with the name of every entry whose unparsed name starts
+ * with `prefix' (NULL for all).  Backends that can do so answer this
+ * without decoding whole entries; for the others it is a full scan.
+ */
+
+krb5_error_code
+hdb_list_principals(krb5_context context,
+		    HDB *db,
+		    const char *prefix,
+		    hdb_name_func_t func,
+		    void *data)
+{
+    struct list_arg arg;
+
+    if (prefix == NULL)
+	prefix = "";
+    if (db->hdb_list_names)
+	return (*db->hdb_list_names)(context, db, prefix, func, data);
+
+    arg.prefix = prefix;
+    arg.len = strlen(prefix);
+    arg.func = func;
+    arg.data = data;
+    return hdb_foreach(context, db, HDB_F_ADMIN_DATA, list_filter, &arg);
+}
+
+/*
+ * The shard an encoded principal (see hdb_principal2key()) belongs
+ * to.  FNV-1a, so that every backend and process agrees.
+ */
+unsigned
+_hdb_key2shard(const krb5_data *key, unsigned nshards)
+{
+    const unsigned char *p = key->data;
+    uint32_t h = 0x811c9dc5;
+    size_t i;
+
+    for (i = 0; i < key->length; i++) {
+	h ^= p[i];
+	h *= 0x01000193;
+    }
+    return h % nshards;
+}
+
+struct shard_arg {
+    unsigned shard;
+    unsigned nshards;
+    hdb_foreach_func_t func;
+    void *data;
+};
+
+static krb5_error_code
+shard_filter(krb5_context context, HDB *db, hdb_entry_ex *entry, void *data)
+{
+    struct shard_arg *arg = data;
+    krb5_error_code ret;
+    krb5_data key;
+
+    ret = hdb_principal2key(context, entry->entry.principal, &key);
+    if (ret)
+	return ret;
+    if (_hdb_key2shard(&key, arg->nshards) == arg->shard)
+	ret = (*arg->func)(context, db, entry, arg->data);
+    krb5_data_free(&key);
+    return ret;
+}
+
+/*
+ * Like hdb_foreach(), but only visits the entries of shard `shard' out
+ * of `nshards'.  Running all shards, in any order and from any number
+ * of processes, visits every entry exactly once.
+ */
+
+krb5_error_code
+hdb_foreach_shard(krb5_context context,
+		  HDB *db,
+		  unsigned flags,
+		  unsigned shard,
+		  unsigned nshards,
+		  hdb_foreach_func_t func,
+		  void *data)
+{
+    struct shard_arg arg;
+    krb5_error_code ret, ret2;
+
+    if (nshards <= 1)
+	return hdb_foreach(context, db, flags, func, data);
+    if (shard >= nshards) {
+	krb5_set_error_message(context, EINVAL,
+			       "shard %u out of range (%u shards)",
+			       shard, nshards);
+	return EINVAL;
+    }
+
+    if (db->hdb_set_shard) {
+	ret = (*db->hdb_set_shard)(context, db, shard, nshards);
+	if (ret)
+	    return ret;
+	ret = hdb_foreach(context, db, flags, func, data);
+	ret2 = (*db->hdb_set_shard)(context, db, 0, 1);
+	return ret ? ret : ret2;
+    }
+
+    arg.shard = shard;
+    arg.nshards = nshards;
+    arg.func = func;
+    arg.data = data;
+    return hdb_foreach(context, db, flags, shard_filter, &arg);
+}
+
+/*
+ * Bulk loading.  Backends that commit (and sync) every store can
+ * instead group entries into transactions of `[kdc] hdb-bulk-batch-size'
+ * stores between hdb_begin_bulk() and hdb_end_bulk().  Backends that
+ * don't support it leave the methods NULL and keep working as before.
+ */
+
+krb5_error_code
+hdb_begin_bulk(krb5_context context, HDB *db)
+{
+    if (db->hdb_begin_bulk == NULL)
+	return 0;
+    return (*db->hdb_begin_bulk)(context, db);
+}
+
+krb5_error_code
+hdb_end_bulk(krb5_context context, HDB *db, int commit)
+{
+    if (db->hdb_end_bulk == NULL)
+	return 0;
+    return (*db->hdb_end_bulk)(context, db, commit);
+}
+
+unsigned
+_hdb_bulk_batch_size(krb5_context context)
+{
+    int n;
+
+    n = krb5_config_get_int_default(context, NULL, 10000, "kdc",
+				    "hdb-bulk-batch-size", NULL);
+    return n > 0 ? n : 1;
+}
+
 krb5_error_code
 hdb_check_db_format(krb5_context context, HDB *db)
 {
@@ -261,9 +261,44 @@ typedef struct HDB {
      * Check if s4u2self is allowed from this client to this server
      */
     krb5_error_code (*hdb_check_s4u2self)(krb5_context, struct HDB *, hdb_entry_ex *, krb5_const_principal);
+
+    /**
+     * Start a bulk load.
+     *
+     * Until ->hdb_end_bulk() is called, stores and removes may be
+     * grouped into large transactions instead of being committed one
+     * at a time.  Callers must not rely on an individual store being
+     * durable before ->hdb_end_bulk() returns.  May be NULL.
+     */
+    krb5_error_code (*hdb_begin_bulk)(krb5_context, struct HDB *);
+    /**
+     * Finish a bulk load, committing outstanding changes if `commit'
+     * is non-zero, otherwise discarding what has not yet been
+     * committed.  May be NULL.
+     */
+    krb5_error_code (*hdb_end_bulk)(krb5_context, struct HDB *, int);
+    /**
+     * Restrict the following ->hdb_firstkey()/->hdb_nextkey() walk to
+     * shard `shard' of `nshards' disjoint parts of the database, so
+     * that several processes can scan it at once.  Entries that are
+     * not in the shard are skipped without being decoded.  A
+     * `nshards' of 1 selects the whole database again.  May be NULL,
+     * see hdb_foreach_shard().
+     */
+    krb5_error_code (*hdb_set_shard)(krb5_context, struct HDB *, unsigned, unsigned);
+    /**
+     * Call the function with the unparsed name of every entry (not
+     * alias) whose name starts with the given prefix.  Backends
+     * answer this from their keys or an index instead of decoding
+     * every entry.  May be NULL, see hdb_list_principals().
+     */
+    krb5_error_code (*hdb_list_names)(krb5_context, struct HDB *, const char *,
+				      krb5_error_code (*)(krb5_context, struct HDB *,
+							  const char *, void *),
+				      void *);
 }HDB;
 
-#define HDB_INTERFACE_VERSION	8
+#define HDB_INTERFACE_VERSION	9
 
 struct hdb_method {
     int			version;
@@ -286,6 +321,8 @@ struct hdb_print_entry_arg {
 
 typedef krb5_error_code (*hdb_foreach_func_t)(krb5_context, HDB*,
 					      hdb_entry_ex*, void*);
+typedef krb5_error_code (*hdb_name_func_t)(krb5_context, HDB*,
+					   const char *, void*);
 extern krb5_kt_ops hdb_kt_ops;
 extern krb5_kt_ops hdb_get_kt_ops;
 
@@ -81,6 +81,8 @@ struct hx509_cert_data {
     hx509_private_key private_key;
     struct _hx509_cert_attrs attrs;
     hx509_name basename;
+    heim_octet_string subject_key;
+    heim_octet_string issuer_key;
     _hx509_cert_release_func release;
     void *ctx;
 };
@@ -167,6 +169,47 @@ hx509_context_set_missing_revoke(hx509_context context, int flag)
 	context->flags &= ~HX509_CTX_VERIFY_MISSING_OK;
 }
 
+/**
+ * Enable or disable the verified-chain cache of the context. When
+ * enabled, hx509_verify_path() remembers certificates whose chain
+ * validated successfully and skips path building, signature and
+ * revocation checking for them until the earliest notAfter in the
+ * chain or the next CRL/OCSP update of the attached revocation
+ * context, whichever comes first. A cached result is only used if the
+ * trust anchor that terminated the chain is still among the anchors
+ * of the verification context, and, when revocation is checked, if it
+ * was checked with the same revocation context and none of its CRL or
+ * OCSP files have been reloaded since.
+ *
+ * @param context hx509 context to change the cache for.
+ * @param max_entries maximum number of certificates to remember, zero
+ * disables and flushes the cache.
+ *
+ * @return An hx509 error code, see hx509_get_error_string().
+ *
+ * @ingroup hx509_verify
+ */
+
+int
+hx509_context_set_verify_cache(hx509_context context, size_t max_entries)
+{
+    heim_release(context->verify_cache);
+    context->verify_cache = NULL;
+    context->verify_cache_len = 0;
+    context->verify_cache_max = max_entries;
+
+    if (max_entries == 0)
+	return 0;
+
+    context->verify_cache = heim_dict_create(max_entries < 11 ? 11 : max_entries);
+    if (context->verify_cache == NULL) {
+	context->verify_cache_max = 0;
+	hx509_clear_error_string(context);
+	return ENOMEM;
+    }
+    return 0;
+}
+
 /**
  * Free the context allocated by hx509_context_init().
  *
@@ -187,6 +230,7 @@ hx509_context_free(hx509_context *context)
     free_error_table ((*context)->et_list);
     if ((*context)->querystat)
 	free((*context)->querystat);
+    heim_release((*context)->verify_cache);
     memset(*context, 0, sizeof(**context));
     free(*context);
     *context = NULL;
@@ -202,6 +246,42 @@ _hx509_get_cert(hx509_cert cert)
     return cert->data;
 }
 
+/*
+ * Normalized subject and issuer name keys, see _hx509_name_key().
+ * They are computed on first use and kept until the certificate is
+ * freed.
+ */
+
+int
+_hx509_cert_subject_key(hx509_cert cert, const heim_octet_string **key)
+{
+    int ret;
+
+    if (cert->subject_key.data == NULL) {
+	ret = _hx509_name_key(&cert->data->tbsCertificate.subject,
+			      &cert->subject_key);
+	if (ret)
+	    return ret;
+    }
+    *key = &cert->subject_key;
+    return 0;
+}
+
+int
+_hx509_cert_issuer_key(hx509_cert cert, const heim_octet_string **key)
+{
+    int ret;
+
+    if (cert->issuer_key.data == NULL) {
+	ret = _hx509_name_key(&cert->data->tbsCertificate.issuer,
+			      &cert->issuer_key);
+	if (ret)
+	    return ret;
+    }
+    *key = &cert->issuer_key;
+    return 0;
+}
+
 /*
  *
  */
@@ -243,6 +323,10 @@ hx509_cert_init(hx509_context context, const Certificate *c, heim_error_t *error
     cert->attrs.val = NULL;
     cert->private_key = NULL;
     cert->basename = NULL;
+    cert->subject_key.data = NULL;
+    cert->subject_key.length = 0;
+    cert->issuer_key.data = NULL;
+    cert->issuer_key.length = 0;
     cert->release = NULL;
     cert->ctx = NULL;
 
@@ -372,6 +456,8 @@ hx509_cert_free(hx509_cert cert)
     free(cert->friendlyname);
     if (cert->basename)
 	hx509_name_free(&cert->basename);
+    der_free_octet_string(&cert->subject_key);
+    der_free_octet_string(&cert->issuer_key);
     memset(cert, 0, sizeof(*cert));
     free(cert);
 }
@@ -615,9 +701,9 @@ find_extension(const Certificate *cert, const heim_oid *oid, size_t *idx)
     return NULL;
 }
 
-static int
-find_extension_auth_key_id(const Certificate *subject,
-			   AuthorityKeyIdentifier *ai)
+int
+_hx509_find_extension_auth_key_id(const Certificate *subject,
+				  AuthorityKeyIdentifier *ai)
 {
     const Extension *e;
     size_t size;
@@ -923,24 +1009,21 @@ check_basic_constraints(hx509_context context, const Certificate *cert,
     return ret;
 }
 
-int
-_hx509_cert_is_parent_cmp(const Certificate *subject,
-			  const Certificate *issuer,
-			  int allow_self_signed)
+/*
+ * The rest of _hx509_cert_is_parent_cmp() once the issuer name of
+ * subject is known to match the subject name of issuer.
+ */
+
+static int
+is_parent_keyid_cmp(const Certificate *subject,
+		    const Certificate *issuer,
+		    int allow_self_signed)
 {
-    int diff;
+    int diff = 0;
     AuthorityKeyIdentifier ai;
     SubjectKeyIdentifier si;
     int ret_ai, ret_si, ret;
 
-    ret = _hx509_name_cmp(&issuer->tbsCertificate.subject,
-			  &subject->tbsCertificate.issuer,
-			  &diff);
-    if (ret)
-	return ret;
-    if (diff)
-	return diff;
-
     memset(&ai, 0, sizeof(ai));
     memset(&si, 0, sizeof(si));
 
@@ -949,7 +1032,7 @@ _hx509_cert_is_parent_cmp(const Certificate *subject,
      * subject certificate nor the parent.
      */
 
-    ret_ai = find_extension_auth_key_id(subject, &ai);
+    ret_ai = _hx509_find_extension_auth_key_id(subject, &ai);
     if (ret_ai && ret_ai != HX509_EXTENSION_NOT_FOUND)
 	return 1;
     ret_si = _hx509_find_extension_subject_key_id(issuer, &si);
@@ -1011,6 +1094,25 @@ _hx509_cert_is_parent_cmp(const Certificate *subject,
     return diff;
 }
 
+int
+_hx509_cert_is_parent_cmp(const Certificate *subject,
+			  const Certificate *issuer,
+			  int allow_self_signed)
+{
+    int diff;
+    int ret;
+
+    ret = _hx509_name_cmp(&issuer->tbsCertificate.subject,
+			  &subject->tbsCertificate.issuer,
+			  &diff);
+    if (ret)
+	return ret;
+    if (diff)
+	return diff;
+
+    return is_parent_keyid_cmp(subject, issuer, allow_self_signed);
+}
+
 static int
 certificate_is_anchor(hx509_context context,
 		      hx509_certs trust_anchors,
@@ -1036,18 +1138,24 @@ certificate_is_anchor(hx509_context context,
 
 static int
 certificate_is_self_signed(hx509_context context,
-			   const Certificate *cert,
+			   hx509_cert cert,
 			   int *self_signed)
 {
-    int ret, diff;
-    ret = _hx509_name_cmp(&cert->tbsCertificate.subject,
-			  &cert->tbsCertificate.issuer, &diff);
-    *self_signed = (diff == 0);
+    const heim_octet_string *subject, *issuer;
+    int ret;
+
+    *self_signed = 0;
+    ret = _hx509_cert_subject_key(cert, &subject);
+    if (ret == 0)
+	ret = _hx509_cert_issuer_key(cert, &issuer);
     if (ret) {
 	hx509_set_error_string(context, 0, ret,
 			       "Failed to check if self signed");
-    } else
-	ret = _hx509_self_signed_valid(context, &cert->signatureAlgorithm);
+    } else {
+	*self_signed = (der_heim_octet_string_cmp(subject, issuer) == 0);
+	ret = _hx509_self_signed_valid(context,
+				       &cert->data->signatureAlgorithm);
+    }
 
     return ret;
 }
@@ -1084,8 +1192,10 @@ find_parent(hx509_context context,
     if (!subject_null_p(current->data)) {
 	q.match |= HX509_QUERY_FIND_ISSUER_CERT;
 	q.subject = _hx509_get_cert(current);
+	if (_hx509_cert_issuer_key(current, &q.issuer_key) != 0)
+	    q.issuer_key = NULL;
     } else {
-	ret = find_extension_auth_key_id(current->data, &ai);
+	ret = _hx509_find_extension_auth_key_id(current->data, &ai);
 	if (ret) {
 	    hx509_set_error_string(context, 0, HX509_CERTIFICATE_MALFORMED,
 				   "Subjectless certificate missing AuthKeyID");
@@ -1971,6 +2081,187 @@ free_name_constraints(hx509_name_constraints *nc)
     free(nc->val);
 }
 
+/*
+ * Verified-chain cache, see hx509_context_set_verify_cache().
+ */
+
+#define VERIFY_CACHE_FLAGS					\
+    (HX509_VERIFY_CTX_F_REQUIRE_RFC3280 |			\
+     HX509_VERIFY_CTX_F_CHECK_TRUST_ANCHORS |			\
+     HX509_VERIFY_CTX_F_NO_BEST_BEFORE_CHECK)
+
+struct verify_cache_entry {
+    hx509_cert anchor;
+    time_t not_before;
+    time_t not_after;
+    int flags;
+    hx509_revoke_ctx revoke_ctx;
+    unsigned long revoke_generation;
+    size_t depth;
+};
+
+static void
+verify_cache_entry_dealloc(void *ptr)
+{
+    struct verify_cache_entry *e = ptr;
+    hx509_cert_free(e->anchor);
+    hx509_revoke_free(&e->revoke_ctx);
+}
+
+static int
+verify_cache_usable(hx509_context context, hx509_verify_ctx ctx)
+{
+    /* proxy certificate validation updates cert->basename */
+    return context->verify_cache != NULL &&
+	(ctx->flags & HX509_VERIFY_CTX_F_ALLOW_PROXY_CERTIFICATE) == 0;
+}
+
+static heim_data_t
+verify_cache_key(hx509_context context, hx509_cert cert)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    heim_octet_string os;
+    int ret;
+
+    ret = hx509_cert_binary(context, cert, &os);
+    if (ret)
+	return NULL;
+    ret = EVP_Digest(os.data, os.length, digest, NULL, EVP_sha256(), NULL);
+    der_free_octet_string(&os);
+    if (ret != 1)
+	return NULL;
+
+    return heim_data_create(digest, sizeof(digest));
+}
+
+static int
+verify_cache_lookup(hx509_context context,
+		    hx509_verify_ctx ctx,
+		    hx509_cert cert,
+		    hx509_certs anchors,
+		    unsigned long revoke_generation)
+{
+    struct verify_cache_entry *e;
+    hx509_query q;
+    hx509_cert c;
+    heim_data_t key;
+    int ret;
+
+    key = verify_cache_key(context, cert);
+    if (key == NULL)
+	return HX509_CERT_NOT_FOUND;
+
+    e = heim_dict_get_value(context->verify_cache, key);
+    if (e == NULL) {
+	heim_release(key);
+	return HX509_CERT_NOT_FOUND;
+    }
+
+    if (ctx->time_now < e->not_before || ctx->time_now >= e->not_after) {
+	heim_dict_delete_key(context->verify_cache, key);
+	context->verify_cache_len--;
+	heim_release(key);
+	return HX509_CERT_NOT_FOUND;
+    }
+    heim_release(key);
+
+    if ((ctx->flags & VERIFY_CACHE_FLAGS) != e->flags ||
+	(ctx->revoke_ctx && (e->revoke_ctx != ctx->revoke_ctx ||
+			     e->revoke_generation != revoke_generation)) ||
+	e->depth > ctx->max_depth)
+	return HX509_CERT_NOT_FOUND;
+
+    _hx509_query_clear(&q);
+    q.match = HX509_QUERY_MATCH_CERTIFICATE;
+    q.certificate = _hx509_get_cert(e->anchor);
+
+    ret = hx509_certs_find(context, anchors, &q, &c);
+    if (ret) {
+	hx509_clear_error_string(context);
+	return ret;
+    }
+    hx509_cert_free(c);
+
+    return 0;
+}
+
+static void
+verify_cache_add(hx509_context context,
+		 hx509_verify_ctx ctx,
+		 hx509_cert cert,
+		 hx509_path *path,
+		 unsigned long revoke_generation)
+{
+    struct verify_cache_entry *e;
+    heim_data_t key;
+    size_t i, len;
+
+    if (path->len == 0)
+	return;
+
+    key = verify_cache_key(context, cert);
+    if (key == NULL)
+	return;
+
+    e = heim_alloc(sizeof(*e), "hx509-verify-cache-entry",
+		   verify_cache_entry_dealloc);
+    if (e == NULL) {
+	heim_release(key);
+	return;
+    }
+    e->anchor = hx509_cert_ref(path->val[path->len - 1]);
+    e->flags = ctx->flags & VERIFY_CACHE_FLAGS;
+    e->revoke_ctx = _hx509_revoke_ref(ctx->revoke_ctx);
+    e->revoke_generation = revoke_generation;
+    e->depth = path->len;
+
+    /*
+     * The validity of the trust anchor is only checked when asked
+     * for, so only let it limit the cache lifetime in that case.
+     */
+    len = CHECK_TA(ctx) ? path->len : path->len - 1;
+    if (len == 0)
+	goto out;
+
+    for (i = 0; i < len; i++) {
+	Certificate *c = _hx509_get_cert(path->val[i]);
+	time_t nb, na;
+
+	nb = _hx509_Time2time_t(&c->tbsCertificate.validity.notBefore);
+	na = _hx509_Time2time_t(&c->tbsCertificate.validity.notAfter);
+	if (i == 0 || nb > e->not_before)
+	    e->not_before = nb;
+	if (i == 0 || na < e->not_after)
+	    e->not_after = na;
+    }
+
+    if (ctx->revoke_ctx &&
+	_hx509_revoke_next_update(ctx->revoke_ctx, &e->not_after) != 0)
+	goto out;
+
+    if (e->not_after <= ctx->time_now)
+	goto out;
+
+    /* Simple eviction, start over when full */
+    if (context->verify_cache_len >= context->verify_cache_max) {
+	heim_release(context->verify_cache);
+	context->verify_cache_len = 0;
+	context->verify_cache = heim_dict_create(context->verify_cache_max);
+	if (context->verify_cache == NULL) {
+	    context->verify_cache_max = 0;
+	    goto out;
+	}
+    }
+
+    if (heim_dict_get_value(context->verify_cache, key) == NULL)
+	context->verify_cache_len++;
+    heim_dict_set_value(context->verify_cache, key, e);
+
+out:
+    heim_release(key);
+    heim_release(e);
+}
+
 /**
  * Build and verify the path for the certificate to the trust anchor
  * specified in the verify context. The path is constructed from the
@@ -1994,6 +2285,7 @@ hx509_verify_path(hx509_context context,
 {
     hx509_name_constraints nc;
     hx509_path path;
+    unsigned long revoke_generation = 0;
     int ret, proxy_cert_depth, selfsigned_depth, diff;
     size_t i, k;
     enum certtype type;
@@ -2035,6 +2327,22 @@ hx509_verify_path(hx509_context context,
 	    goto out;
     }
 
+    /*
+     * The revocation generation is taken before the path is checked,
+     * a CRL or OCSP reload during the check only makes the cached
+     * result miss next time.
+     */
+    if (verify_cache_usable(context, ctx)) {
+	if (ctx->revoke_ctx)
+	    revoke_generation = _hx509_revoke_generation(context,
+							 ctx->revoke_ctx);
+	if (verify_cache_lookup(context, ctx, cert, anchors,
+				revoke_generation) == 0) {
+	    ret = 0;
+	    goto out;
+	}
+    }
+
     /*
      * Calculate the path from the certificate user presented to the
      * to an anchor.
@@ -2088,7 +2396,8 @@ hx509_verify_path(hx509_context context,
 	    if (i + 1 != path.len) {
 		int selfsigned;
 
-		ret = certificate_is_self_signed(context, c, &selfsigned);
+		ret = certificate_is_self_signed(context, path.val[i],
+						 &selfsigned);
 		if (ret)
 		    goto out;
 		if (selfsigned)
@@ -2277,7 +2586,7 @@ hx509_verify_path(hx509_context context,
 
 	c = _hx509_get_cert(path.val[i]);
 
-	ret = certificate_is_self_signed(context, c, &selfsigned);
+	ret = certificate_is_self_signed(context, path.val[i], &selfsigned);
 	if (ret)
 	    goto out;
 
@@ -2356,7 +2665,7 @@ hx509_verify_path(hx509_context context,
 
 	    signer = path.val[i];
 
-	    ret = certificate_is_self_signed(context, signer->data, &selfsigned);
+	    ret = certificate_is_self_signed(context, signer, &selfsigned);
 	    if (ret)
 		goto out;
 
@@ -2391,6 +2700,9 @@ hx509_verify_path(hx509_context context,
 	}
     }
 
+    if (verify_cache_usable(context, ctx))
+	verify_cache_add(context, ctx, cert, &path, revoke_generation);
+
 out:
     hx509_certs_free(&anchors);
     free_Name(&proxy_issuer);
@@ -2968,9 +3280,20 @@ _hx509_query_match_cert(hx509_context context, const hx509_query *q, hx509_cert
 
     _hx509_query_statistic(context, 1, q);
 
-    if ((q->match & HX509_QUERY_FIND_ISSUER_CERT) &&
-	_hx509_cert_is_parent_cmp(q->subject, c, 0) != 0)
-	return 0;
+    if (q->match & HX509_QUERY_FIND_ISSUER_CERT) {
+	const heim_octet_string *key;
+
+	if (q->issuer_key == NULL) {
+	    if (_hx509_cert_is_parent_cmp(q->subject, c, 0) != 0)
+		return 0;
+	} else {
+	    if (_hx509_cert_subject_key(cert, &key) != 0 ||
+		der_heim_octet_string_cmp(q->issuer_key, key) != 0)
+		return 0;
+	    if (is_parent_keyid_cmp(q->subject, c, 0) != 0)
+		return 0;
+	}
+    }
 
     if ((q->match & HX509_QUERY_MATCH_CERTIFICATE) &&
 	_hx509_Certificate_cmp(q->certificate, c) != 0)
@@ -139,6 +139,7 @@ struct hx509_query_data {
 #define HX509_QUERY_MATCH_EXPR			0x800000
 #define HX509_QUERY_MASK			0xffffff
     Certificate *subject;
+    const heim_octet_string *issuer_key;
     Certificate *certificate;
     heim_integer *serial;
     heim_octet_string *subject_id;
@@ -192,6 +193,9 @@ struct hx509_context_data {
     struct et_list *et_list;
     char *querystat;
     hx509_certs default_trust_anchors;
+    heim_dict_t verify_cache;
+    size_t verify_cache_len;
+    size_t verify_cache_max;
 };
 
 /* _hx509_calculate_path flag field */
@@ -907,6 +907,11 @@ pcert_verify(struct verify_options *opt, int argc, char **argv)
 	v.hostname = opt->hostname_string;
     if (opt->max_depth_integer)
 	hx509_verify_set_max_depth(ctx, opt->max_depth_integer);
+    if (opt->verify_cache_integer > 0) {
+	ret = hx509_context_set_verify_cache(context, opt->verify_cache_integer);
+	if (ret)
+	    hx509_err(context, 1, ret, "hx509_context_set_verify_cache");
+    }
 
     ret = hx509_revoke_init(context, &revoke_ctx);
     if (ret)
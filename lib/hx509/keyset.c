@@ -53,6 +53,9 @@
  * - PKCS11
  * - PKCS12
  * - DIR
+ * - CACHED-DIR
+ *   Same as DIR, but loads all certificates into memory and reloads
+ *   files that changed, useful for large anchor and pool directories.
  * - KEYCHAIN
  *   Apple Mac OS X KeyChain backed keychain object.
  *
@@ -217,8 +217,332 @@ static struct hx509_keyset_ops keyset_dir = {
     NULL
 };
 
+/*
+ * CACHED-DIR is the opposite of DIR: all certificates in the
+ * directory are loaded into one (indexed) MEMORY store that is used
+ * for queries and iteration. At most once a second the directory is
+ * scanned again, and only files that appeared or whose size, inode or
+ * mtime changed are parsed again. Errors are ignored just like DIR.
+ */
+
+struct cdir_file {
+    char *fn;
+    time_t mtime;
+    off_t size;
+    ino_t ino;
+    int seen;
+    hx509_certs certs;
+};
+
+struct cdir {
+    char *dir;
+    time_t last_check;
+    struct {
+	size_t len;
+	struct cdir_file *val;
+    } files;
+    hx509_certs certs;
+};
+
+struct cdir_cursor {
+    hx509_certs certs;
+    void *iter;
+};
+
+static int
+cdir_file_cmp(const void *a, const void *b)
+{
+    const struct cdir_file *fa = a, *fb = b;
+    return strcmp(fa->fn, fb->fn);
+}
+
+static void
+cdir_file_free(struct cdir_file *f)
+{
+    free(f->fn);
+    hx509_certs_free(&f->certs);
+}
+
+static struct cdir_file *
+cdir_file_find(struct cdir *cd, size_t len, char *fn)
+{
+    struct cdir_file key;
+
+    key.fn = fn;
+    return bsearch(&key, cd->files.val, len, sizeof(cd->files.val[0]),
+		   cdir_file_cmp);
+}
+
+static void
+cdir_file_load(hx509_context context, struct cdir_file *f,
+	       const struct stat *sb)
+{
+    char *fn;
+
+    hx509_certs_free(&f->certs);
+
+    f->mtime = sb->st_mtime;
+    f->size = sb->st_size;
+    f->ino = sb->st_ino;
+
+    if (asprintf(&fn, "FILE:%s", f->fn) == -1)
+	return;
+    /* ignore errors */
+    if (hx509_certs_init(context, fn, 0, NULL, &f->certs) != 0) {
+	hx509_clear_error_string(context);
+	f->certs = NULL;
+    }
+    free(fn);
+}
+
+static int
+cdir_refresh(hx509_context context, struct cdir *cd)
+{
+    struct dirent *dir;
+    size_t i, j, sorted;
+    hx509_certs certs;
+    int changed = 0;
+    time_t now;
+    DIR *d;
+    int ret;
+
+    now = time(NULL);
+    if (cd->certs && cd->last_check == now)
+	return 0;
+    cd->last_check = now;
+
+    d = opendir(cd->dir);
+    if (d == NULL) {
+	ret = errno;
+	if (cd->certs)
+	    return 0; /* keep what we have */
+	hx509_set_error_string(context, 0, ret,
+			       "Failed to open directory %s", cd->dir);
+	return ret;
+    }
+    rk_cloexec_dir(d);
+
+    for (i = 0; i < cd->files.len; i++)
+	cd->files.val[i].seen = 0;
+    sorted = cd->files.len;
+
+    while ((dir = readdir(d)) != NULL) {
+	struct cdir_file *f;
+	struct stat sb;
+	char *fn;
+
+	if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+	    continue;
+
+	if (asprintf(&fn, "%s/%s", cd->dir, dir->d_name) == -1) {
+	    closedir(d);
+	    hx509_clear_error_string(context);
+	    return ENOMEM;
+	}
+	if (stat(fn, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+	    free(fn);
+	    continue;
+	}
+
+	f = cdir_file_find(cd, sorted, fn);
+	if (f) {
+	    free(fn);
+	    f->seen = 1;
+	    if (f->mtime == sb.st_mtime && f->size == sb.st_size &&
+		f->ino == sb.st_ino)
+		continue;
+	} else {
+	    f = realloc(cd->files.val,
+			(cd->files.len + 1) * sizeof(cd->files.val[0]));
+	    if (f == NULL) {
+		free(fn);
+		closedir(d);
+		hx509_clear_error_string(context);
+		return ENOMEM;
+	    }
+	    cd->files.val = f;
+	    f = &cd->files.val[cd->files.len++];
+	    memset(f, 0, sizeof(*f));
+	    f->fn = fn;
+	    f->seen = 1;
+	}
+	cdir_file_load(context, f, &sb);
+	changed = 1;
+    }
+    closedir(d);
+
+    /* drop removed files and keep the list sorted for the next scan */
+    for (i = 0, j = 0; i < cd->files.len; i++) {
+	if (cd->files.val[i].seen == 0) {
+	    cdir_file_free(&cd->files.val[i]);
+	    changed = 1;
+	    continue;
+	}
+	cd->files.val[j++] = cd->files.val[i];
+    }
+    cd->files.len = j;
+    qsort(cd->files.val, cd->files.len, sizeof(cd->files.val[0]),
+	  cdir_file_cmp);
+
+    if (!changed && cd->certs)
+	return 0;
+
+    ret = hx509_certs_init(context, "MEMORY:cached-dir", 0, NULL, &certs);
+    if (ret)
+	return ret;
+    for (i = 0; i < cd->files.len; i++) {
+	if (cd->files.val[i].certs == NULL)
+	    continue;
+	ret = hx509_certs_merge(context, certs, cd->files.val[i].certs);
+	if (ret) {
+	    hx509_certs_free(&certs);
+	    return ret;
+	}
+    }
+    hx509_certs_free(&cd->certs);
+    cd->certs = certs;
+
+    return 0;
+}
+
+static int
+cdir_init(hx509_context context,
+	  hx509_certs certs, void **data, int flags,
+	  const char *residue, hx509_lock lock)
+{
+    struct cdir *cd;
+    int ret;
+
+    ret = dir_init(context, certs, data, flags, residue, lock);
+    if (ret)
+	return ret;
+
+    cd = calloc(1, sizeof(*cd));
+    if (cd == NULL) {
+	free(*data);
+	*data = NULL;
+	hx509_clear_error_string(context);
+	return ENOMEM;
+    }
+    cd->dir = *data;
+    *data = NULL;
+
+    ret = cdir_refresh(context, cd);
+    if (ret) {
+	free(cd->dir);
+	free(cd);
+	return ret;
+    }
+
+    *data = cd;
+    return 0;
+}
+
+static int
+cdir_free(hx509_certs certs, void *data)
+{
+    struct cdir *cd = data;
+    size_t i;
+
+    for (i = 0; i < cd->files.len; i++)
+	cdir_file_free(&cd->files.val[i]);
+    free(cd->files.val);
+    hx509_certs_free(&cd->certs);
+    free(cd->dir);
+    free(cd);
+    return 0;
+}
+
+static int
+cdir_query(hx509_context context,
+	   hx509_certs certs,
+	   void *data,
+	   const hx509_query *q,
+	   hx509_cert *r)
+{
+    struct cdir *cd = data;
+    int ret;
+
+    ret = cdir_refresh(context, cd);
+    if (ret)
+	return ret;
+    return hx509_certs_find(context, cd->certs, q, r);
+}
+
+static int
+cdir_iter_start(hx509_context context,
+		hx509_certs certs, void *data, void **cursor)
+{
+    struct cdir *cd = data;
+    struct cdir_cursor *c;
+    int ret;
+
+    *cursor = NULL;
+
+    ret = cdir_refresh(context, cd);
+    if (ret)
+	return ret;
+
+    c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+	hx509_clear_error_string(context);
+	return ENOMEM;
+    }
+    /* a refresh while iterating must not pull the store away */
+    c->certs = hx509_certs_ref(cd->certs);
+
+    ret = hx509_certs_start_seq(context, c->certs, &c->iter);
+    if (ret) {
+	hx509_certs_free(&c->certs);
+	free(c);
+	return ret;
+    }
+
+    *cursor = c;
+    return 0;
+}
+
+static int
+cdir_iter(hx509_context context,
+	  hx509_certs certs, void *data, void *iter, hx509_cert *cert)
+{
+    struct cdir_cursor *c = iter;
+    return hx509_certs_next_cert(context, c->certs, c->iter, cert);
+}
+
+static int
+cdir_iter_end(hx509_context context,
+	      hx509_certs certs,
+	      void *data,
+	      void *cursor)
+{
+    struct cdir_cursor *c = cursor;
+
+    hx509_certs_end_seq(context, c->certs, c->iter);
+    hx509_certs_free(&c->certs);
+    free(c);
+    return 0;
+}
+
+static struct hx509_keyset_ops keyset_cached_dir = {
+    "CACHED-DIR",
+    0,
+    cdir_init,
+    NULL,
+    cdir_free,
+    NULL,
+    cdir_query,
+    cdir_iter_start,
+    cdir_iter,
+    cdir_iter_end,
+    NULL,
+    NULL,
+    NULL
+};
+
 void
 _hx509_ks_dir_register(hx509_context context)
 {
     _hx509_ks_register(context, &keyset_dir);
+    _hx509_ks_register(context, &keyset_cached_dir);
 }
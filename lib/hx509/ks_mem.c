@@ -34,9 +34,14 @@
 #include "hx_locl.h"
 
 /*
- * Should use two hash/tree certificates intead of a array.  Criteria
- * should be subject and subjectKeyIdentifier since those two are
- * commonly seached on in CMS and path building.
+ * Certificates are kept in an array in the order they were added,
+ * iteration walks the array. To make hx509_certs_find() cheap for
+ * large stores (trust anchors, certificate pools) the first query
+ * builds a hash index from subject name, serial number,
+ * subjectKeyIdentifier and SHA-1 of the public key to the positions
+ * in the array, which is then kept up to date by mem_add().  Subject
+ * names are indexed by their normalized key, see _hx509_name_key(),
+ * so a name lookup only has to look in its own bucket.
  */
 
 struct mem_data {
@@ -46,8 +51,137 @@ struct mem_data {
 	hx509_cert *val;
     } certs;
     hx509_private_key *keys;
+    heim_dict_t index;
 };
 
+#define MEM_INDEX_SUBJECT	'n'
+#define MEM_INDEX_SERIAL	's'
+#define MEM_INDEX_SKI		'k'
+#define MEM_INDEX_KEYHASH	'h'
+
+/* smaller stores are just scanned */
+#define MEM_INDEX_MIN_CERTS	8
+
+static heim_data_t
+mem_index_key(int type, const void *data, size_t length)
+{
+    unsigned char *p;
+    heim_data_t key;
+
+    p = malloc(length + 1);
+    if (p == NULL)
+	return NULL;
+    p[0] = type;
+    memcpy(p + 1, data, length);
+    key = heim_data_create(p, length + 1);
+    free(p);
+    return key;
+}
+
+static int
+mem_index_add_key(struct mem_data *mem, int type,
+		  const void *data, size_t length, unsigned long idx)
+{
+    heim_data_t key;
+    heim_array_t a;
+    heim_number_t n;
+    int ret;
+
+    key = mem_index_key(type, data, length);
+    if (key == NULL)
+	return ENOMEM;
+
+    a = heim_dict_copy_value(mem->index, key);
+    if (a == NULL) {
+	a = heim_array_create();
+	if (a == NULL) {
+	    heim_release(key);
+	    return ENOMEM;
+	}
+	ret = heim_dict_set_value(mem->index, key, a);
+	if (ret) {
+	    heim_release(a);
+	    heim_release(key);
+	    return ret;
+	}
+    }
+    heim_release(key);
+
+    n = heim_number_create(idx);
+    if (n == NULL) {
+	heim_release(a);
+	return ENOMEM;
+    }
+    ret = heim_array_append_value(a, n);
+    heim_release(n);
+    heim_release(a);
+    return ret;
+}
+
+static int
+mem_index_add(struct mem_data *mem, unsigned long idx)
+{
+    Certificate *c = _hx509_get_cert(mem->certs.val[idx]);
+    const heim_octet_string *name;
+    const heim_bit_string *spk;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SubjectKeyIdentifier si;
+    int ret;
+
+    /* a subject that can't be normalized never matches by name */
+    if (_hx509_cert_subject_key(mem->certs.val[idx], &name) == 0) {
+	ret = mem_index_add_key(mem, MEM_INDEX_SUBJECT,
+				name->data, name->length, idx);
+	if (ret)
+	    return ret;
+    }
+
+    ret = mem_index_add_key(mem, MEM_INDEX_SERIAL,
+			    c->tbsCertificate.serialNumber.data,
+			    c->tbsCertificate.serialNumber.length, idx);
+    if (ret)
+	return ret;
+
+    if (_hx509_find_extension_subject_key_id(c, &si) == 0) {
+	ret = mem_index_add_key(mem, MEM_INDEX_SKI, si.data, si.length, idx);
+	free_SubjectKeyIdentifier(&si);
+	if (ret)
+	    return ret;
+    }
+
+    spk = &c->tbsCertificate.subjectPublicKeyInfo.subjectPublicKey;
+    if (EVP_Digest(spk->data, spk->length / 8, digest, NULL,
+		   EVP_sha1(), NULL) == 1) {
+	ret = mem_index_add_key(mem, MEM_INDEX_KEYHASH,
+				digest, sizeof(digest), idx);
+	if (ret)
+	    return ret;
+    }
+
+    return 0;
+}
+
+static int
+mem_index_build(struct mem_data *mem)
+{
+    unsigned long i;
+    int ret;
+
+    mem->index = heim_dict_create(mem->certs.len < 11 ? 11 : mem->certs.len);
+    if (mem->index == NULL)
+	return ENOMEM;
+
+    for (i = 0; i < mem->certs.len; i++) {
+	ret = mem_index_add(mem, i);
+	if (ret) {
+	    heim_release(mem->index);
+	    mem->index = NULL;
+	    return ret;
+	}
+    }
+    return 0;
+}
+
 static int
 mem_init(hx509_context context,
 	 hx509_certs certs, void **data, int flags,
@@ -81,6 +215,7 @@ mem_free(hx509_certs certs, void *data)
 	hx509_private_key_free(&mem->keys[i]);
     free(mem->keys);
     free(mem->name);
+    heim_release(mem->index);
     free(mem);
 
     return 0;
@@ -101,9 +236,151 @@ mem_add(hx509_context context, hx509_certs certs, void *data, hx509_cert c)
     mem->certs.val[mem->certs.len] = hx509_cert_ref(c);
     mem->certs.len++;
 
+    if (mem->index && mem_index_add(mem, mem->certs.len - 1) != 0) {
+	heim_release(mem->index);
+	mem->index = NULL;
+    }
+
+    return 0;
+}
+
+/*
+ * Pick the index bucket that contains every certificate that can
+ * match the query. Returns 0 and sets *key to NULL when no index
+ * applies. *exact is set to zero when the bucket is only a good
+ * guess and a miss must be followed by a full scan.
+ */
+
+static int
+mem_query_key(const hx509_query *q, heim_data_t *key, int *exact)
+{
+    heim_octet_string name;
+    const void *data = NULL;
+    size_t length = 0;
+    int type = 0;
+
+    *key = NULL;
+    *exact = 1;
+
+    if (q->match & HX509_QUERY_MATCH_SUBJECT_KEY_ID) {
+	type = MEM_INDEX_SKI;
+	data = q->subject_id->data;
+	length = q->subject_id->length;
+    } else if (q->match & HX509_QUERY_MATCH_CERTIFICATE) {
+	type = MEM_INDEX_SERIAL;
+	data = q->certificate->tbsCertificate.serialNumber.data;
+	length = q->certificate->tbsCertificate.serialNumber.length;
+    } else if (q->match & HX509_QUERY_MATCH_SERIALNUMBER) {
+	type = MEM_INDEX_SERIAL;
+	data = q->serial->data;
+	length = q->serial->length;
+    } else if ((q->match & HX509_QUERY_MATCH_KEY_HASH_SHA1) &&
+	       q->keyhash_sha1->length == SHA_DIGEST_LENGTH) {
+	type = MEM_INDEX_KEYHASH;
+	data = q->keyhash_sha1->data;
+	length = q->keyhash_sha1->length;
+    } else if (q->match & HX509_QUERY_FIND_ISSUER_CERT) {
+	AuthorityKeyIdentifier ai;
+
+	/*
+	 * With an authorityKeyIdentifier in the subject the issuer
+	 * must carry the same subjectKeyIdentifier or serial number,
+	 * see _hx509_cert_is_parent_cmp().
+	 */
+	if (_hx509_find_extension_auth_key_id(q->subject, &ai) == 0) {
+	    if (ai.keyIdentifier)
+		*key = mem_index_key(MEM_INDEX_SKI, ai.keyIdentifier->data,
+				     ai.keyIdentifier->length);
+	    else if (ai.authorityCertSerialNumber)
+		*key = mem_index_key(MEM_INDEX_SERIAL,
+				     ai.authorityCertSerialNumber->data,
+				     ai.authorityCertSerialNumber->length);
+	    free_AuthorityKeyIdentifier(&ai);
+	    if (*key)
+		return 0;
+	}
+	if (q->issuer_key) {
+	    type = MEM_INDEX_SUBJECT;
+	    data = q->issuer_key->data;
+	    length = q->issuer_key->length;
+	} else if (_hx509_name_key(&q->subject->tbsCertificate.issuer,
+				   &name) == 0) {
+	    *key = mem_index_key(MEM_INDEX_SUBJECT, name.data, name.length);
+	    der_free_octet_string(&name);
+	    return *key ? 0 : ENOMEM;
+	}
+    } else if (q->match & HX509_QUERY_MATCH_SUBJECT_NAME) {
+	if (_hx509_name_key(q->subject_name, &name) == 0) {
+	    *key = mem_index_key(MEM_INDEX_SUBJECT, name.data, name.length);
+	    der_free_octet_string(&name);
+	    return *key ? 0 : ENOMEM;
+	}
+    }
+
+    if (type == 0)
+	return 0;
+
+    *key = mem_index_key(type, data, length);
+    if (*key == NULL)
+	return ENOMEM;
     return 0;
 }
 
+static int
+mem_query(hx509_context context,
+	  hx509_certs certs,
+	  void *data,
+	  const hx509_query *q,
+	  hx509_cert *r)
+{
+    struct mem_data *mem = data;
+    heim_data_t key = NULL;
+    heim_array_t a;
+    unsigned long i;
+    size_t j;
+    int ret, exact = 0;
+
+    *r = NULL;
+
+    if (mem->index == NULL && mem->certs.len >= MEM_INDEX_MIN_CERTS)
+	(void)mem_index_build(mem);
+
+    if (mem->index) {
+	ret = mem_query_key(q, &key, &exact);
+	if (ret) {
+	    hx509_clear_error_string(context);
+	    return ret;
+	}
+    }
+
+    if (key) {
+	a = heim_dict_get_value(mem->index, key);
+	heim_release(key);
+
+	for (j = 0; a && j < heim_array_get_length(a); j++) {
+	    i = heim_number_get_int(heim_array_get_value(a, j));
+	    if (_hx509_query_match_cert(context, q, mem->certs.val[i])) {
+		*r = hx509_cert_ref(mem->certs.val[i]);
+		return 0;
+	    }
+	}
+	if (exact) {
+	    hx509_clear_error_string(context);
+	    return HX509_CERT_NOT_FOUND;
+	}
+    }
+
+    for (i = 0; i < mem->certs.len; i++) {
+	if (_hx509_query_match_cert(context, q, mem->certs.val[i])) {
+	    *r = hx509_cert_ref(mem->certs.val[i]);
+	    return 0;
+	}
+    }
+
+    hx509_clear_error_string(context);
+    return HX509_CERT_NOT_FOUND;
+}
+
 static int
 mem_iter_start(hx509_context context,
 	       hx509_certs certs,
@@ -207,7 +484,7 @@ static struct hx509_keyset_ops keyset_mem = {
     NULL,
     mem_free,
     mem_add,
-    NULL,
+    mem_query,
     mem_iter_start,
     mem_iter,
     mem_iter_end,
@@ -455,7 +455,7 @@ _hx509_name_cmp(const Name *n1, const Name *n2, int *c)
 
 	for (j = 0; j < n1->u.rdnSequence.val[i].len; j++) {
 	    *c = der_heim_oid_cmp(&n1->u.rdnSequence.val[i].val[j].type,
-				  &n1->u.rdnSequence.val[i].val[j].type);
+				  &n2->u.rdnSequence.val[i].val[j].type);
 	    if (*c)
 		return 0;
 
@@ -472,6 +472,108 @@ _hx509_name_cmp(const Name *n1, const Name *n2, int *c)
     return 0;
 }
 
+/*
+ * Canonical key of a Name: two names give the same key exactly when
+ * _hx509_name_cmp() finds them equal, so a key can be compared with
+ * memcmp() and used as a hash key.  It is a sequence of 32 bit big
+ * endian words: the number of RDNs, then for each RDN the number of
+ * attributes, and for each attribute the OID components and the
+ * stringprepped value, both prefixed by their length.
+ */
+
+struct name_key {
+    unsigned char *data;
+    size_t len, size;
+};
+
+static int
+name_key_reserve(struct name_key *k, size_t num)
+{
+    unsigned char *p;
+    size_t size;
+
+    if (k->len + 4 * num <= k->size)
+	return 0;
+    size = k->size * 2 + 4 * num;
+    p = realloc(k->data, size);
+    if (p == NULL)
+	return ENOMEM;
+    k->data = p;
+    k->size = size;
+    return 0;
+}
+
+static void
+name_key_put(struct name_key *k, uint32_t val)
+{
+    unsigned char *p = k->data + k->len;
+
+    p[0] = (val >> 24) & 0xff;
+    p[1] = (val >> 16) & 0xff;
+    p[2] = (val >> 8) & 0xff;
+    p[3] = val & 0xff;
+    k->len += 4;
+}
+
+int
+_hx509_name_key(const Name *n, heim_octet_string *key)
+{
+    struct name_key k = { NULL, 0, 0 };
+    const RelativeDistinguishedName *rdn;
+    const heim_oid *oid;
+    uint32_t *name;
+    size_t i, j, l, len;
+    int ret;
+
+    key->data = NULL;
+    key->length = 0;
+
+    ret = name_key_reserve(&k, 1);
+    if (ret)
+	return ret;
+    name_key_put(&k, n->u.rdnSequence.len);
+
+    for (i = 0; i < n->u.rdnSequence.len; i++) {
+	rdn = &n->u.rdnSequence.val[i];
+
+	ret = name_key_reserve(&k, 1);
+	if (ret)
+	    goto out;
+	name_key_put(&k, rdn->len);
+
+	for (j = 0; j < rdn->len; j++) {
+	    oid = &rdn->val[j].type;
+	    ret = name_key_reserve(&k, oid->length + 1);
+	    if (ret)
+		goto out;
+	    name_key_put(&k, oid->length);
+	    for (l = 0; l < oid->length; l++)
+		name_key_put(&k, oid->components[l]);
+
+	    ret = dsstringprep(&rdn->val[j].value, &name, &len);
+	    if (ret)
+		goto out;
+	    ret = name_key_reserve(&k, len + 1);
+	    if (ret) {
+		free(name);
+		goto out;
+	    }
+	    name_key_put(&k, len);
+	    for (l = 0; l < len; l++)
+		name_key_put(&k, name[l]);
+	    free(name);
+	}
+    }
+
+    key->data = k.data;
+    key->length = k.len;
+    return 0;
+
+ out:
+    free(k.data);
+    return ret;
+}
+
 /**
  * Compare to hx509 name object, useful for sorting.
  *
@@ -51,10 +51,24 @@
 
 #include "hx_locl.h"
 
+/*
+ * Entries of a CRL or OCSP response sorted by serial number, so that
+ * checking a certificate is a binary search even for large CRLs.
+ */
+
+struct revoke_index {
+    size_t len;
+    struct revoke_index_entry {
+	const heim_integer *serial;
+	size_t idx;
+    } *val;
+};
+
 struct revoke_crl {
     char *path;
     time_t last_modfied;
     CRLCertificateList crl;
+    struct revoke_index index;
     int verified;
     int failed_verify;
 };
@@ -63,6 +77,7 @@ struct revoke_ocsp {
     char *path;
     time_t last_modfied;
     OCSPBasicOCSPResponse ocsp;
+    struct revoke_index index;
     hx509_certs certs;
     hx509_cert signer;
 };
@@ -70,6 +85,7 @@ struct revoke_ocsp {
 
 struct hx509_revoke_ctx_data {
     unsigned int ref;
+    unsigned long generation;	/* bumped when a CRL/OCSP is (re)loaded */
     struct {
 	struct revoke_crl *val;
 	size_t len;
@@ -80,6 +96,98 @@ struct hx509_revoke_ctx_data {
     } ocsps;
 };
 
+static int
+revoke_index_cmp(const void *a, const void *b)
+{
+    const struct revoke_index_entry *ea = a, *eb = b;
+    int diff;
+
+    diff = der_heim_integer_cmp(ea->serial, eb->serial);
+    if (diff)
+	return diff;
+    /* keep the file order for duplicates */
+    return ea->idx < eb->idx ? -1 : ea->idx > eb->idx;
+}
+
+static void
+revoke_index_free(struct revoke_index *ri)
+{
+    free(ri->val);
+    ri->val = NULL;
+    ri->len = 0;
+}
+
+static int
+revoke_index_crl(const CRLCertificateList *crl, struct revoke_index *ri)
+{
+    size_t i, len;
+
+    ri->len = 0;
+    ri->val = NULL;
+
+    if (crl->tbsCertList.revokedCertificates == NULL)
+	return 0;
+    len = crl->tbsCertList.revokedCertificates->len;
+    if (len == 0)
+	return 0;
+
+    ri->val = malloc(len * sizeof(ri->val[0]));
+    if (ri->val == NULL)
+	return ENOMEM;
+    for (i = 0; i < len; i++) {
+	ri->val[i].serial =
+	    &crl->tbsCertList.revokedCertificates->val[i].userCertificate;
+	ri->val[i].idx = i;
+    }
+    ri->len = len;
+    qsort(ri->val, ri->len, sizeof(ri->val[0]), revoke_index_cmp);
+    return 0;
+}
+
+static int
+revoke_index_ocsp(const OCSPBasicOCSPResponse *ocsp, struct revoke_index *ri)
+{
+    const OCSPResponseData *rd = &ocsp->tbsResponseData;
+    size_t i;
+
+    ri->len = 0;
+    ri->val = NULL;
+
+    if (rd->responses.len == 0)
+	return 0;
+
+    ri->val = malloc(rd->responses.len * sizeof(ri->val[0]));
+    if (ri->val == NULL)
+	return ENOMEM;
+    for (i = 0; i < rd->responses.len; i++) {
+	ri->val[i].serial = &rd->responses.val[i].certID.serialNumber;
+	ri->val[i].idx = i;
+    }
+    ri->len = rd->responses.len;
+    qsort(ri->val, ri->len, sizeof(ri->val[0]), revoke_index_cmp);
+    return 0;
+}
+
+/*
+ * Return the position of the first entry with the serial number, or
+ * the position where it would have been.
+ */
+
+static size_t
+revoke_index_find(const struct revoke_index *ri, const heim_integer *serial)
+{
+    size_t lo = 0, hi = ri->len, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (der_heim_integer_cmp(ri->val[mid].serial, serial) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
 /**
  * Allocate a revokation context. Free with hx509_revoke_free().
  *
@@ -124,6 +232,7 @@ static void
 free_ocsp(struct revoke_ocsp *ocsp)
 {
     free(ocsp->path);
+    revoke_index_free(&ocsp->index);
     free_OCSPBasicOCSPResponse(&ocsp->ocsp);
     hx509_certs_free(&ocsp->certs);
     hx509_cert_free(ocsp->signer);
@@ -152,6 +261,7 @@ hx509_revoke_free(hx509_revoke_ctx *ctx)
 
     for (i = 0; i < (*ctx)->crls.len; i++) {
 	free((*ctx)->crls.val[i].path);
+	revoke_index_free(&(*ctx)->crls.val[i].index);
 	free_CRLCertificateList(&(*ctx)->crls.val[i].crl);
     }
 
@@ -326,6 +436,7 @@ static int
 load_ocsp(hx509_context context, struct revoke_ocsp *ocsp)
 {
     OCSPBasicOCSPResponse basic;
+    struct revoke_index index;
     hx509_certs certs = NULL;
     size_t length;
     struct stat sb;
@@ -372,13 +483,23 @@ load_ocsp(hx509_context context, struct revoke_ocsp *ocsp)
 	}
     }
 
+    ret = revoke_index_ocsp(&basic, &index);
+    if (ret) {
+	hx509_certs_free(&certs);
+	free_OCSPBasicOCSPResponse(&basic);
+	hx509_clear_error_string(context);
+	return ret;
+    }
+
     ocsp->last_modfied = sb.st_mtime;
 
+    revoke_index_free(&ocsp->index);
     free_OCSPBasicOCSPResponse(&ocsp->ocsp);
     hx509_certs_free(&ocsp->certs);
     hx509_cert_free(ocsp->signer);
 
     ocsp->ocsp = basic;
+    ocsp->index = index;
     ocsp->certs = certs;
     ocsp->signer = NULL;
 
@@ -443,6 +564,7 @@ hx509_revoke_add_ocsp(hx509_context context,
 	return ret;
     }
     ctx->ocsps.len++;
+    ctx->generation++;
 
     return ret;
 }
@@ -682,11 +804,75 @@ hx509_revoke_add_crl(hx509_context context,
 	return ret;
     }
 
+    ret = revoke_index_crl(&ctx->crls.val[ctx->crls.len].crl,
+			   &ctx->crls.val[ctx->crls.len].index);
+    if (ret) {
+	free_CRLCertificateList(&ctx->crls.val[ctx->crls.len].crl);
+	free(ctx->crls.val[ctx->crls.len].path);
+	hx509_clear_error_string(context);
+	return ret;
+    }
+
     ctx->crls.len++;
+    ctx->generation++;
 
     return ret;
 }
 
+/*
+ * Reload an OCSP response or CRL if the file changed since it was
+ * loaded. A failed reload keeps the old one.
+ */
+
+static int
+refresh_ocsp(hx509_context context,
+	     hx509_revoke_ctx ctx,
+	     struct revoke_ocsp *ocsp)
+{
+    struct stat sb;
+    int ret;
+
+    ret = stat(ocsp->path, &sb);
+    if (ret == 0 && ocsp->last_modfied != sb.st_mtime) {
+	ret = load_ocsp(context, ocsp);
+	if (ret)
+	    return ret;
+	ctx->generation++;
+    }
+    return 0;
+}
+
+static void
+refresh_crl(hx509_context context,
+	    hx509_revoke_ctx ctx,
+	    struct revoke_crl *crl)
+{
+    struct revoke_index index;
+    CRLCertificateList cl;
+    struct stat sb;
+    int ret;
+
+    ret = stat(crl->path, &sb);
+    if (ret || crl->last_modfied == sb.st_mtime)
+	return;
+
+    ret = load_crl(context, crl->path, &crl->last_modfied, &cl);
+    if (ret == 0) {
+	ret = revoke_index_crl(&cl, &index);
+	if (ret)
+	    free_CRLCertificateList(&cl);
+    }
+    if (ret == 0) {
+	revoke_index_free(&crl->index);
+	free_CRLCertificateList(&crl->crl);
+	crl->crl = cl;
+	crl->index = index;
+	crl->verified = 0;
+	crl->failed_verify = 0;
+	ctx->generation++;
+    }
+}
+
 /**
  * Check that a certificate is not expired according to a revokation
  * context. Also need the parent certificte to the check OCSP
@@ -715,23 +901,20 @@ hx509_revoke_verify(hx509_context context,
     const Certificate *c = _hx509_get_cert(cert);
     const Certificate *p = _hx509_get_cert(parent_cert);
     unsigned long i, j, k;
+    size_t n;
     int ret;
 
     hx509_clear_error_string(context);
 
     for (i = 0; i < ctx->ocsps.len; i++) {
 	struct revoke_ocsp *ocsp = &ctx->ocsps.val[i];
-	struct stat sb;
 
 	/* check this ocsp apply to this cert */
 
 	/* check if there is a newer version of the file */
-	ret = stat(ocsp->path, &sb);
-	if (ret == 0 && ocsp->last_modfied != sb.st_mtime) {
-	    ret = load_ocsp(context, ocsp);
-	    if (ret)
-		continue;
-	}
+	ret = refresh_ocsp(context, ctx, ocsp);
+	if (ret)
+	    continue;
 
 	/* verify signature in ocsp if not already done */
 	if (ocsp->signer == NULL) {
@@ -740,20 +923,21 @@ hx509_revoke_verify(hx509_context context,
 		continue;
 	}
 
-	for (j = 0; j < ocsp->ocsp.tbsResponseData.responses.len; j++) {
+	for (n = revoke_index_find(&ocsp->index, &c->tbsCertificate.serialNumber);
+	     n < ocsp->index.len; n++) {
 	    heim_octet_string os;
 
-	    ret = der_heim_integer_cmp(&ocsp->ocsp.tbsResponseData.responses.val[j].certID.serialNumber,
-				   &c->tbsCertificate.serialNumber);
-	    if (ret != 0)
-		continue;
+	    if (der_heim_integer_cmp(ocsp->index.val[n].serial,
+				     &c->tbsCertificate.serialNumber) != 0)
+		break;
+	    j = ocsp->index.val[n].idx;
 
 	    /* verify issuer hashes hash */
 	    ret = _hx509_verify_signature(context,
 					  NULL,
-					  &ocsp->ocsp.tbsResponseData.responses.val[i].certID.hashAlgorithm,
+					  &ocsp->ocsp.tbsResponseData.responses.val[j].certID.hashAlgorithm,
 					  &c->tbsCertificate.issuer._save,
-					  &ocsp->ocsp.tbsResponseData.responses.val[i].certID.issuerNameHash);
+					  &ocsp->ocsp.tbsResponseData.responses.val[j].certID.issuerNameHash);
 	    if (ret != 0)
 		continue;
 
@@ -797,7 +981,6 @@ hx509_revoke_verify(hx509_context context,
 
     for (i = 0; i < ctx->crls.len; i++) {
 	struct revoke_crl *crl = &ctx->crls.val[i];
-	struct stat sb;
 	int diff;
 
 	/* check if cert.issuer == crls.val[i].crl.issuer */
@@ -806,18 +989,7 @@ hx509_revoke_verify(hx509_context context,
 	if (ret || diff)
 	    continue;
 
-	ret = stat(crl->path, &sb);
-	if (ret == 0 && crl->last_modfied != sb.st_mtime) {
-	    CRLCertificateList cl;
-
-	    ret = load_crl(context, crl->path, &crl->last_modfied, &cl);
-	    if (ret == 0) {
-		free_CRLCertificateList(&crl->crl);
-		crl->crl = cl;
-		crl->verified = 0;
-		crl->failed_verify = 0;
-	    }
-	}
+	refresh_crl(context, ctx, crl);
 	if (crl->failed_verify)
 	    continue;
 
@@ -846,13 +1018,14 @@ hx509_revoke_verify(hx509_context context,
 	    return 0;
 
 	/* check if cert is in crl */
-	for (j = 0; j < crl->crl.tbsCertList.revokedCertificates->len; j++) {
+	for (n = revoke_index_find(&crl->index, &c->tbsCertificate.serialNumber);
+	     n < crl->index.len; n++) {
 	    time_t t;
 
-	    ret = der_heim_integer_cmp(&crl->crl.tbsCertList.revokedCertificates->val[j].userCertificate,
-				       &c->tbsCertificate.serialNumber);
-	    if (ret != 0)
-		continue;
+	    if (der_heim_integer_cmp(crl->index.val[n].serial,
+				     &c->tbsCertificate.serialNumber) != 0)
+		break;
+	    j = crl->index.val[n].idx;
 
 	    t = _hx509_Time2time_t(&crl->crl.tbsCertList.revokedCertificates->val[j].revocationDate);
 	    if (t > now)
@@ -882,6 +1055,63 @@ hx509_revoke_verify(hx509_context context,
     return HX509_REVOKE_STATUS_MISSING;
 }
 
+/*
+ * Lower `t´ to the earliest nextUpdate of all CRLs and OCSP responses
+ * in the revocation context, ie the time until which a result from
+ * hx509_revoke_verify() can be trusted. Returns non-zero if some CRL
+ * or OCSP response has no nextUpdate, then there is no such time.
+ */
+
+int
+_hx509_revoke_next_update(hx509_revoke_ctx ctx, time_t *t)
+{
+    size_t i, j;
+    time_t n;
+
+    for (i = 0; i < ctx->crls.len; i++) {
+	struct revoke_crl *crl = &ctx->crls.val[i];
+
+	if (crl->crl.tbsCertList.nextUpdate == NULL)
+	    return HX509_CRL_USED_AFTER_TIME;
+	n = _hx509_Time2time_t(crl->crl.tbsCertList.nextUpdate);
+	if (n < *t)
+	    *t = n;
+    }
+
+    for (i = 0; i < ctx->ocsps.len; i++) {
+	struct revoke_ocsp *ocsp = &ctx->ocsps.val[i];
+
+	for (j = 0; j < ocsp->ocsp.tbsResponseData.responses.len; j++) {
+	    OCSPSingleResponse *r = &ocsp->ocsp.tbsResponseData.responses.val[j];
+
+	    if (r->nextUpdate == NULL)
+		return HX509_CRL_USED_AFTER_TIME;
+	    if (*r->nextUpdate < *t)
+		*t = *r->nextUpdate;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Reload changed CRL and OCSP files and return a counter that changes
+ * whenever one of them is (re)loaded, so that a result remembered
+ * from hx509_revoke_verify() can be checked against the current
+ * revocation data.
+ */
+
+unsigned long
+_hx509_revoke_generation(hx509_context context, hx509_revoke_ctx ctx)
+{
+    size_t i;
+
+    for (i = 0; i < ctx->ocsps.len; i++)
+	(void)refresh_ocsp(context, ctx, &ctx->ocsps.val[i]);
+    for (i = 0; i < ctx->crls.len; i++)
+	refresh_crl(context, ctx, &ctx->crls.val[i]);
+    return ctx->generation;
+}
+
 struct ocsp_add_ctx {
     OCSPTBSRequest *req;
     hx509_certs certs;
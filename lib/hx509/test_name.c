@@ -349,6 +349,31 @@ test_compare(hx509_context context)
     return 0;
 }
 
+static int
+test_compare_names(hx509_context context, const char *name1,
+		   const char *name2, int equal)
+{
+    hx509_name n1, n2;
+    int ret;
+
+    ret = hx509_parse_name(context, name1, &n1);
+    if (ret)
+	return 1;
+    ret = hx509_parse_name(context, name2, &n2);
+    if (ret) {
+	hx509_name_free(&n1);
+	return 1;
+    }
+
+    ret = hx509_name_cmp(n1, n2);
+    hx509_name_free(&n1);
+    hx509_name_free(&n2);
+
+    if ((ret == 0) != equal)
+	return 1;
+    return 0;
+}
+
 
 int
 main(int argc, char **argv)
@@ -375,6 +400,9 @@ main(int argc, char **argv)
     ret += test_expand(context, "UID=${uid}{uid},C=SE", "UID=lha{uid},C=SE");
 
     ret += test_compare(context);
+    ret += test_compare_names(context, "CN=foo,C=SE", "CN=foo,C=SE", 1);
+    ret += test_compare_names(context, "CN=foo,C=SE", "CN=bar,C=SE", 0);
+    ret += test_compare_names(context, "CN=foo,C=SE", "OU=foo,C=SE", 0);
 
     hx509_context_free(&context);
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2026 Heimdal contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holders nor the names of their
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Check the verified-chain cache from one process, which hxtool
+ * verify cannot do: a certificate verified once through an
+ * intermediate verifies again without it, until the CRL of the
+ * anchor is replaced by one that revokes the intermediate.
+ *
+ * usage: test_verify_cache cert intermediate anchor crl revoking-crl
+ */
+
+#include "hx_locl.h"
+#include <err.h>
+
+static const char *crlfile = "test-verify-cache.crl";
+
+static void
+copy_file(const char *from, const char *to)
+{
+    size_t len;
+    void *data;
+    int ret;
+
+    ret = rk_undumpdata(from, &data, &len);
+    if (ret)
+	errx(1, "read %s: %d", from, ret);
+    rk_dumpdata(to, data, len);
+    free(data);
+}
+
+static hx509_certs
+load_certs(hx509_context context, const char *fn)
+{
+    hx509_certs certs;
+    char *s;
+    int ret;
+
+    if (asprintf(&s, "FILE:%s", fn) < 0 || s == NULL)
+	errx(1, "out of memory");
+    ret = hx509_certs_init(context, s, 0, NULL, &certs);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_certs_init: %s", s);
+    free(s);
+    return certs;
+}
+
+static int
+verify(hx509_context context, hx509_certs anchors, hx509_revoke_ctx revoke,
+       hx509_cert cert, hx509_certs pool)
+{
+    hx509_verify_ctx ctx;
+    int ret;
+
+    ret = hx509_verify_init_ctx(context, &ctx);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_verify_init_ctx");
+    hx509_verify_attach_anchors(ctx, anchors);
+    hx509_verify_attach_revoke(ctx, revoke);
+
+    ret = hx509_verify_path(context, ctx, cert, pool);
+    hx509_verify_destroy_ctx(ctx);
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    hx509_context context;
+    hx509_certs certs, chain, anchors;
+    hx509_revoke_ctx revoke;
+    hx509_cert cert;
+    char *s;
+    int ret;
+
+    if (argc != 6)
+	errx(1, "usage: %s cert intermediate anchor crl revoking-crl",
+	     argv[0]);
+
+    ret = hx509_context_init(&context);
+    if (ret)
+	errx(1, "hx509_context_init failed with %d", ret);
+
+    ret = hx509_context_set_verify_cache(context, 10);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_context_set_verify_cache");
+    /* Only the anchor has a CRL, the intermediate has none */
+    hx509_context_set_missing_revoke(context, 1);
+
+    certs = load_certs(context, argv[1]);
+    chain = load_certs(context, argv[2]);
+    anchors = load_certs(context, argv[3]);
+
+    ret = hx509_get_one_cert(context, certs, &cert);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_get_one_cert");
+
+    copy_file(argv[4], crlfile);
+
+    ret = hx509_revoke_init(context, &revoke);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_revoke_init");
+    if (asprintf(&s, "FILE:%s", crlfile) < 0 || s == NULL)
+	errx(1, "out of memory");
+    ret = hx509_revoke_add_crl(context, revoke, s);
+    if (ret)
+	hx509_err(context, 1, ret, "hx509_revoke_add_crl: %s", s);
+    free(s);
+
+    ret = verify(context, anchors, revoke, cert, chain);
+    if (ret)
+	hx509_err(context, 1, ret, "verify with intermediate");
+
+    /* Only a cached result can do without the intermediate */
+    ret = verify(context, anchors, revoke, cert, NULL);
+    if (ret)
+	hx509_err(context, 1, ret, "verify from the cache");
+
+    /* CRL changes are noticed by modification time */
+    sleep(1);
+    copy_file(argv[5], crlfile);
+
+    ret = verify(context, anchors, revoke, cert, NULL);
+    if (ret == 0)
+	errx(1, "cached result used after the CRL changed");
+
+    ret = verify(context, anchors, revoke, cert, chain);
+    if (ret == 0)
+	errx(1, "revoked intermediate accepted");
+
+    hx509_cert_free(cert);
+    hx509_certs_free(&certs);
+    hx509_certs_free(&chain);
+    hx509_certs_free(&anchors);
+    hx509_revoke_free(&revoke);
+    hx509_context_free(&context);
+
+    unlink(crlfile);
+
+    return 0;
+}
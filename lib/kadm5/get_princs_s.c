@@ -47,22 +47,24 @@ add_princ(struct foreach_data *d, char *princ)
 {
     char **tmp;
     tmp = realloc(d->princs, (d->count + 1) * sizeof(*tmp));
-    if(tmp == NULL)
+    if(tmp == NULL) {
+	free(princ);
 	return ENOMEM;
+    }
     d->princs = tmp;
     d->princs[d->count++] = princ;
     return 0;
 }
 
 static krb5_error_code
-foreach(krb5_context context, HDB *db, hdb_entry_ex *ent, void *data)
+foreach(krb5_context context, HDB *db, const char *name, void *data)
 {
     struct foreach_data *d = data;
     char *princ;
-    krb5_error_code ret;
-    ret = krb5_unparse_name(context, ent->entry.principal, &princ);
-    if(ret)
-	return ret;
+    krb5_error_code ret = 0;
+    princ = strdup(name);
+    if(princ == NULL)
+	return ENOMEM;
     if(d->exp){
 	if(fnmatch(d->exp, princ, 0) == 0 || fnmatch(d->exp2, princ, 0) == 0)
 	    ret = add_princ(d, princ);
@@ -71,8 +73,6 @@ foreach(krb5_context context, HDB *db, hdb_entry_ex *ent, void *data)
     }else{
 	ret = add_princ(d, princ);
     }
-    if(ret)
-	free(princ);
     return ret;
 }
 
@@ -85,6 +85,7 @@ kadm5_s_get_principals(void *server_handle,
     struct foreach_data d;
     kadm5_server_context *context = server_handle;
     kadm5_ret_t ret;
+    char *prefix;
 
     if (!context->keep_open) {
 	ret = context->db->hdb_open(context->context, context->db, O_RDONLY, 0);
@@ -94,6 +95,9 @@ kadm5_s_get_principals(void *server_handle,
 	}
     }
     d.exp = expression;
+    d.princs = NULL;
+    d.count = 0;
+    prefix = NULL;
     {
 	krb5_realm r;
 	int aret;
@@ -102,12 +106,26 @@ kadm5_s_get_principals(void *server_handle,
 	aret = asprintf(&d.exp2, "%s@%s", expression, r);
 	free(r);
 	if (aret == -1 || d.exp2 == NULL) {
-	    return ENOMEM;
+	    d.exp2 = NULL;
+	    ret = ENOMEM;
+	    goto out;
 	}
     }
-    d.princs = NULL;
-    d.count = 0;
-    ret = hdb_foreach(context->context, context->db, HDB_F_ADMIN_DATA, foreach, &d);
+    /*
+     * Both patterns start with the same literal prefix, which lets the
+     * backend skip everything else; fnmatch() still decides.
+     */
+    if (expression) {
+	prefix = strndup(expression, strcspn(expression, "*?[\\"));
+	if (prefix == NULL) {
+	    ret = ENOMEM;
+	    goto out;
+	}
+    }
+    ret = hdb_list_principals(context->context, context->db, prefix,
+			      foreach, &d);
+ out:
+    free(prefix);
     if (!context->keep_open)
 	context->db->hdb_close(context->context, context->db);
     if(ret == 0)
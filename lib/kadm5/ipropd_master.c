@@ -685,8 +685,10 @@ send_diffs (krb5_context context, slave *s, int log_fd,
 	    krb5_err(context, 1, ret,
 		     "send_diffs: failed to find previous entry");
 	left = krb5_storage_seek(sp, -16, SEEK_CUR);
-	if (ver == s->version)
+	if (ver == s->version) {
+	    krb5_storage_free(sp);
 	    return 0;
+	}
 	if (ver == s->version + 1)
 	    break;
 	if (left == 0) {
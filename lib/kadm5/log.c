@@ -823,7 +823,7 @@ kadm5_log_foreach (kadm5_server_context *context,
     krb5_storage *sp;
 
     lseek (fd, 0, SEEK_SET);
-    sp = krb5_storage_from_fd (fd);
+    sp = krb5_storage_from_fd_buffered (fd);
     for (;;) {
 	int32_t ver, timestamp, op, len, len2, ver2;
 
@@ -853,7 +853,7 @@ kadm5_log_goto_end (int fd)
 {
     krb5_storage *sp;
 
-    sp = krb5_storage_from_fd (fd);
+    sp = krb5_storage_from_fd_buffered (fd);
     krb5_storage_seek(sp, 0, SEEK_END);
     return sp;
 }
@@ -601,6 +601,114 @@ _krb5_config_copy(krb5_context context,
 
 #endif /* HEIMDAL_SMALLER */
 
+/*
+ * Lookup index over a parsed configuration tree.
+ *
+ * Every binding is entered under the pair (head of the list it is in,
+ * its name), so that finding a name in a section is a hash probe
+ * rather than a walk of the whole section.  Within a bucket, entries
+ * keep the order of the tree, so lookups return the same binding the
+ * list walk would.  The tree must not change while it is indexed.
+ */
+
+struct config_index_entry {
+    const krb5_config_binding *head;
+    const krb5_config_binding *binding;
+    struct config_index_entry *next;
+};
+
+struct krb5_config_index {
+    size_t mask;
+    struct config_index_entry **buckets;
+    struct config_index_entry *entries;
+};
+
+static size_t
+config_index_hash(const krb5_config_binding *head, const char *name)
+{
+    size_t h = 2166136261U;
+
+    while (*name)
+	h = (h ^ (unsigned char)*name++) * 16777619U;
+    return h ^ ((uintptr_t)head >> 4) * 2654435761U;
+}
+
+static size_t
+config_index_count(const krb5_config_binding *b)
+{
+    size_t n = 0;
+
+    for (; b != NULL; b = b->next) {
+	n++;
+	if (b->type == krb5_config_list)
+	    n += config_index_count(b->u.list);
+    }
+    return n;
+}
+
+static void
+config_index_add(struct krb5_config_index *idx,
+		 const krb5_config_binding *head,
+		 struct config_index_entry **e)
+{
+    const krb5_config_binding *b;
+    struct config_index_entry **tail;
+
+    for (b = head; b != NULL; b = b->next) {
+	(*e)->head = head;
+	(*e)->binding = b;
+	tail = &idx->buckets[config_index_hash(head, b->name) & idx->mask];
+	while (*tail)
+	    tail = &(*tail)->next;
+	*tail = (*e)++;
+	if (b->type == krb5_config_list)
+	    config_index_add(idx, b->u.list, e);
+    }
+}
+
+/*
+ * Builds the lookup index for the configuration tree `c'.  Returns
+ * NULL if `c' is empty or memory is short, lookups then walk the tree.
+ */
+
+KRB5_LIB_FUNCTION struct krb5_config_index * KRB5_LIB_CALL
+_krb5_config_index(const krb5_config_section *c)
+{
+    struct krb5_config_index *idx;
+    struct config_index_entry *e;
+    size_t n, nbuckets;
+
+    n = config_index_count(c);
+    if (n == 0)
+	return NULL;
+    for (nbuckets = 16; nbuckets < n; nbuckets <<= 1)
+	;
+
+    idx = calloc(1, sizeof(*idx));
+    if (idx == NULL)
+	return NULL;
+    idx->mask = nbuckets - 1;
+    idx->buckets = calloc(nbuckets, sizeof(idx->buckets[0]));
+    idx->entries = calloc(n, sizeof(idx->entries[0]));
+    if (idx->buckets == NULL || idx->entries == NULL) {
+	_krb5_config_index_free(idx);
+	return NULL;
+    }
+    e = idx->entries;
+    config_index_add(idx, c, &e);
+    return idx;
+}
+
+KRB5_LIB_FUNCTION void KRB5_LIB_CALL
+_krb5_config_index_free(struct krb5_config_index *idx)
+{
+    if (idx == NULL)
+	return;
+    free(idx->buckets);
+    free(idx->entries);
+    free(idx);
+}
+
 KRB5_LIB_FUNCTION const void * KRB5_LIB_CALL
 _krb5_config_get_next (krb5_context context,
 		       const krb5_config_section *c,
@@ -640,6 +748,35 @@ vget_next(krb5_context context,
     return NULL;
 }
 
+static const void *
+vget_next_indexed(krb5_context context,
+		  const struct krb5_config_index *idx,
+		  const krb5_config_binding *head,
+		  const krb5_config_binding **pointer,
+		  int type,
+		  const char *name,
+		  va_list args)
+{
+    const char *p = va_arg(args, const char *);
+    const struct config_index_entry *e;
+    const krb5_config_binding *b;
+
+    e = idx->buckets[config_index_hash(head, name) & idx->mask];
+    for (; e != NULL; e = e->next) {
+	b = e->binding;
+	if (e->head != head || strcmp(b->name, name) != 0)
+	    continue;
+	if(b->type == (unsigned)type && p == NULL) {
+	    *pointer = b;
+	    return b->u.generic;
+	} else if(b->type == krb5_config_list && p != NULL) {
+	    return vget_next_indexed(context, idx, b->u.list, pointer,
+				     type, p, args);
+	}
+    }
+    return NULL;
+}
+
 KRB5_LIB_FUNCTION const void * KRB5_LIB_CALL
 _krb5_config_vget_next (krb5_context context,
 			const krb5_config_section *c,
@@ -662,6 +799,9 @@ _krb5_config_vget_next (krb5_context context,
 	p = va_arg(args, const char *);
 	if (p == NULL)
 	    return NULL;
+	if (context != NULL && c == context->cf && context->cf_index != NULL)
+	    return vget_next_indexed(context, context->cf_index, c, pointer,
+				     type, p, args);
 	return vget_next(context, c, pointer, type, p, args);
     }
 
@@ -214,6 +214,8 @@ init_context_from_config_file(krb5_context context)
     INIT_FIELD(context, bool, srv_lookup, context->srv_lookup, "dns_lookup_kdc");
     INIT_FIELD(context, int, large_msg_size, 1400, "large_message_size");
     INIT_FIELD(context, int, max_msg_size, 1000 * 1024, "maximum_message_size");
+    INIT_FIELD(context, int, kdc_conn_cache_size, 0, "kdc_connection_cache_size");
+    INIT_FIELD(context, time, kdc_conn_cache_timeout, 3, "kdc_connection_cache_timeout");
     INIT_FLAG(context, flags, KRB5_CTX_F_DNS_CANONICALIZE_HOSTNAME, TRUE, "dns_canonicalize_hostname");
     INIT_FLAG(context, flags, KRB5_CTX_F_CHECK_PAC, TRUE, "check_pac");
 
@@ -378,6 +380,155 @@ init_context_once(void *ctx)
 }
 
 
+static void
+free_config(krb5_context context)
+{
+    if (context->cf_snapshot) {
+	heim_release(context->cf_snapshot);
+    } else {
+	_krb5_config_index_free(context->cf_index);
+	krb5_config_file_free(context, context->cf);
+    }
+    context->cf_snapshot = NULL;
+    context->cf_index = NULL;
+    context->cf = NULL;
+}
+
+/*
+ * The default configuration files are parsed once per process and the
+ * result is shared, read-only, by every context krb5_init_context()
+ * creates.  The snapshot is reparsed when the list of files changes or
+ * one of them is replaced, modified or appears or disappears.
+ * krb5_set_config_files() always gives the context a private copy.
+ */
+
+#ifndef _WIN32
+
+struct config_stamp {
+    int exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    time_t ctime;
+};
+
+struct config_snapshot {
+    char **files;
+    struct config_stamp *stamps;
+    krb5_config_section *cf;
+    struct krb5_config_index *index;
+};
+
+static HEIMDAL_MUTEX config_snapshot_mutex = HEIMDAL_MUTEX_INITIALIZER;
+static struct config_snapshot *config_snapshot;
+
+static void
+config_snapshot_dealloc(void *ptr)
+{
+    struct config_snapshot *s = ptr;
+
+    krb5_free_config_files(s->files);
+    free(s->stamps);
+    _krb5_config_index_free(s->index);
+    /* krb5_config_file_free() does not use the context */
+    krb5_config_file_free(NULL, s->cf);
+}
+
+static void
+config_stamp(const char *fn, struct config_stamp *st)
+{
+    struct stat sb;
+
+    memset(st, 0, sizeof(*st));
+    if (stat(fn, &sb) != 0)
+	return;
+    st->exists = 1;
+    st->dev = sb.st_dev;
+    st->ino = sb.st_ino;
+    st->size = sb.st_size;
+    st->mtime = sb.st_mtime;
+    st->ctime = sb.st_ctime;
+}
+
+static int
+config_snapshot_current(struct config_snapshot *s, char **files)
+{
+    struct config_stamp st;
+    size_t i;
+
+    for (i = 0; files[i] && s->files[i]; i++) {
+	if (strcmp(files[i], s->files[i]) != 0)
+	    return 0;
+	config_stamp(files[i], &st);
+	if (memcmp(&st, &s->stamps[i], sizeof(st)) != 0)
+	    return 0;
+    }
+    return files[i] == NULL && s->files[i] == NULL;
+}
+
+static krb5_error_code
+set_default_config_files(krb5_context context, char **files)
+{
+    struct config_snapshot *s;
+    krb5_error_code ret;
+    size_t i, n;
+
+    /* Names relative to the home directory depend on the caller */
+    for (n = 0; files[n]; n++)
+	if (files[n][0] == '~' || files[n][0] == '%')
+	    return krb5_set_config_files(context, files);
+
+    HEIMDAL_MUTEX_lock(&config_snapshot_mutex);
+    s = config_snapshot;
+    if (s && config_snapshot_current(s, files))
+	heim_retain(s);
+    else
+	s = NULL;
+    HEIMDAL_MUTEX_unlock(&config_snapshot_mutex);
+
+    if (s == NULL) {
+	s = heim_alloc(sizeof(*s), "krb5-config-snapshot",
+		       config_snapshot_dealloc);
+	if (s == NULL)
+	    return krb5_enomem(context);
+	s->files = calloc(n + 1, sizeof(s->files[0]));
+	s->stamps = calloc(n + 1, sizeof(s->stamps[0]));
+	if (s->files == NULL || s->stamps == NULL) {
+	    heim_release(s);
+	    return krb5_enomem(context);
+	}
+	for (i = 0; i < n; i++) {
+	    s->files[i] = strdup(files[i]);
+	    if (s->files[i] == NULL) {
+		heim_release(s);
+		return krb5_enomem(context);
+	    }
+	    /* Stamp before parsing so a concurrent update forces a reparse */
+	    config_stamp(files[i], &s->stamps[i]);
+	    ret = krb5_config_parse_file_multi(context, files[i], &s->cf);
+	    if (ret != 0 && ret != ENOENT && ret != EACCES && ret != EPERM) {
+		heim_release(s);
+		return ret;
+	    }
+	}
+	s->index = _krb5_config_index(s->cf);
+
+	HEIMDAL_MUTEX_lock(&config_snapshot_mutex);
+	heim_release(config_snapshot);
+	config_snapshot = heim_retain(s);
+	HEIMDAL_MUTEX_unlock(&config_snapshot_mutex);
+    }
+
+    free_config(context);
+    context->cf_snapshot = s;
+    context->cf = s->cf;
+    context->cf_index = s->index;
+    return init_context_from_config_file(context);
+}
+
+#endif /* !_WIN32 */
+
 /**
  * Initializes the context structure and reads the configuration file
  * /etc/krb5.conf. The structure should be freed by calling
@@ -434,7 +585,12 @@ krb5_init_context(krb5_context *context)
     ret = krb5_get_default_config_files(&files);
     if(ret)
 	goto out;
+#ifdef _WIN32
+    /* The registry is merged in too; don't try to track that */
     ret = krb5_set_config_files(p, files);
+#else
+    ret = set_default_config_files(p, files);
+#endif
     krb5_free_config_files(files);
     if(ret)
 	goto out;
@@ -551,9 +707,16 @@ krb5_copy_context(krb5_context context, krb5_context *out)
 	    goto out;
     }
 
-    ret = _krb5_config_copy(context, context->cf, &p->cf);
-    if (ret)
-	goto out;
+    if (context->cf_snapshot) {
+	p->cf_snapshot = heim_retain(context->cf_snapshot);
+	p->cf = context->cf;
+	p->cf_index = context->cf_index;
+    } else {
+	ret = _krb5_config_copy(context, context->cf, &p->cf);
+	if (ret)
+	    goto out;
+	p->cf_index = _krb5_config_index(p->cf);
+    }
 
     /* XXX should copy */
     krb5_init_ets(p);
@@ -608,7 +771,7 @@ krb5_free_context(krb5_context context)
     free(context->etypes);
     free(context->etypes_des);
     krb5_free_host_realm (context, context->default_realms);
-    krb5_config_file_free (context, context->cf);
+    free_config(context);
     free_error_table (context->et_list);
     free(rk_UNCONST(context->cc_ops));
     free(context->kt_types);
@@ -620,6 +783,7 @@ krb5_free_context(krb5_context context)
     krb5_set_extra_addresses(context, NULL);
     krb5_set_ignore_addresses(context, NULL);
     krb5_set_send_to_kdc_func(context, NULL, NULL);
+    heim_release(context->kdc_conn_cache);
 
 #ifdef PKINIT
     if (context->hx509ctx)
@@ -672,8 +836,9 @@ krb5_set_config_files(krb5_context context, char **filenames)
     _krb5_load_config_from_registry(context, &tmp);
 #endif
 
-    krb5_config_file_free(context, context->cf);
+    free_config(context);
     context->cf = tmp;
+    context->cf_index = _krb5_config_index(tmp);
     ret = init_context_from_config_file(context);
     return ret;
 }
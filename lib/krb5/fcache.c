@@ -654,7 +654,7 @@ init_fcc(krb5_context context,
     if(ret)
 	return ret;
 
-    sp = krb5_storage_from_fd(fd);
+    sp = krb5_storage_from_fd_buffered(fd);
     if(sp == NULL) {
 	krb5_clear_error_message(context);
 	ret = ENOMEM;
@@ -863,15 +863,15 @@ fcc_get_next (krb5_context context,
 
     if((ret = fcc_lock(context, id, FCC_CURSOR(*cursor)->fd, FALSE)) != 0)
 	return ret;
-    FCC_CURSOR(*cursor)->cred_start = lseek(FCC_CURSOR(*cursor)->fd,
-					   0, SEEK_CUR);
+    FCC_CURSOR(*cursor)->cred_start =
+	krb5_storage_seek(FCC_CURSOR(*cursor)->sp, 0, SEEK_CUR);
 
     ret = krb5_ret_creds(FCC_CURSOR(*cursor)->sp, creds);
     if (ret)
 	krb5_clear_error_message(context);
 
-    FCC_CURSOR(*cursor)->cred_end = lseek(FCC_CURSOR(*cursor)->fd,
-					 0, SEEK_CUR);
+    FCC_CURSOR(*cursor)->cred_end =
+	krb5_storage_seek(FCC_CURSOR(*cursor)->sp, 0, SEEK_CUR);
 
     fcc_unlock(context, FCC_CURSOR(*cursor)->fd);
     return ret;
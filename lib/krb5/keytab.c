@@ -612,8 +612,12 @@ krb5_kt_get_entry_wrapped(krb5_context context,
     krb5_error_code ret;
     krb5_kt_cursor cursor;
 
-    if(id->get)
-	return (*id->get)(context, id, principal, kvno, enctype, entry);
+    /* a get function may leave lookups it can't index to the scan */
+    if(id->get) {
+	ret = (*id->get)(context, id, principal, kvno, enctype, entry);
+	if (ret != KRB5_PLUGIN_NO_HANDLE)
+	    return ret;
+    }
 
     ret = krb5_kt_start_seq_get (context, id, &cursor);
     if (ret) {
@@ -382,7 +382,7 @@ fkt_start_seq_get_int(krb5_context context,
 	close(c->fd);
 	return ret;
     }
-    c->sp = krb5_storage_from_fd(c->fd);
+    c->sp = krb5_storage_from_fd_buffered(c->fd);
     if (c->sp == NULL) {
 	_krb5_xunlock(context, c->fd);
 	close(c->fd);
@@ -510,6 +510,420 @@ fkt_end_seq_get(krb5_context context,
     return 0;
 }
 
+/*
+ * Index for krb5_kt_get_entry() lookups.
+ *
+ * The index maps a hash of the principal name to the kvno, enctype
+ * and file offset of each entry, so a lookup only decodes the entries
+ * of the principal searched for.  It holds no key material.  Indexes
+ * are shared by all handles on the same file, since callers like
+ * krb5_rd_req() resolve the default keytab for each request, and are
+ * revalidated against the file's device, inode, size and mtime.  An
+ * index built in the same second as the last modification of the
+ * file is used once but not kept, since a later change in that second
+ * would go unnoticed.
+ */
+
+struct fkt_index_entry {
+    uint32_t hash;
+    krb5_kvno vno;
+    krb5_enctype enctype;
+    off_t offset;
+};
+
+struct fkt_index {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    int needs_canon;		/* some entry has a name needing canon */
+    size_t len;
+    struct fkt_index_entry *val;
+};
+
+static HEIMDAL_MUTEX fkt_index_mutex = HEIMDAL_MUTEX_INITIALIZER;
+static heim_dict_t fkt_indexes;
+
+static void
+fkt_index_free(void *ptr)
+{
+    struct fkt_index *idx = ptr;
+    free(idx->val);
+}
+
+static uint32_t
+fkt_hash_update(uint32_t h, const unsigned char *p, size_t len)
+{
+    while (len--) {
+	h ^= *p++;
+	h *= 16777619;
+    }
+    return h;
+}
+
+/*
+ * Names are compared with strcmp(), so only hash up to the first NUL,
+ * and end each string with one to separate the components.
+ */
+
+static uint32_t
+fkt_hash_string(uint32_t h, const char *str)
+{
+    return fkt_hash_update(h, (const unsigned char *)str, strlen(str) + 1);
+}
+
+static uint32_t
+fkt_hash_principal(krb5_const_principal p)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    h = fkt_hash_string(h, p->realm);
+    for (i = 0; i < p->name.name_string.len; i++)
+	h = fkt_hash_string(h, p->name.name_string.val[i]);
+    return h;
+}
+
+/* like krb5_kt_ret_string(), hashing instead of allocating */
+
+static krb5_error_code
+fkt_ret_hash_string(krb5_storage *sp, uint32_t *h)
+{
+    unsigned char buf[128], *nul;
+    krb5_error_code ret;
+    int16_t size;
+    int done = 0;
+    int n, hn;
+
+    ret = krb5_ret_int16(sp, &size);
+    if (ret)
+	return ret;
+    if (size < 0)
+	return KRB5_KT_END;
+    while (size > 0) {
+	n = min(size, (int)sizeof(buf));
+	if (krb5_storage_read(sp, buf, n) != n)
+	    return KRB5_KT_END;
+	if (!done) {
+	    hn = n;
+	    nul = memchr(buf, '\0', n);
+	    if (nul) {
+		hn = nul - buf;
+		done = 1;
+	    }
+	    *h = fkt_hash_update(*h, buf, hn);
+	}
+	size -= n;
+    }
+    *h = fkt_hash_update(*h, (const unsigned char *)"", 1);
+    return 0;
+}
+
+/* like krb5_kt_ret_principal(), hashing instead of allocating */
+
+static krb5_error_code
+fkt_ret_hash_principal(krb5_storage *sp, uint32_t *h, int *needs_canon)
+{
+    krb5_error_code ret;
+    int16_t len;
+    int32_t tmp32;
+
+    *h = 2166136261U;
+
+    ret = krb5_ret_int16(sp, &len);
+    if (ret)
+	return ret;
+    if (krb5_storage_is_flags(sp, KRB5_STORAGE_PRINCIPAL_WRONG_NUM_COMPONENTS))
+	len--;
+    if (len < 0)
+	return KRB5_KT_END;
+    ret = fkt_ret_hash_string(sp, h);
+    while (ret == 0 && len-- > 0)
+	ret = fkt_ret_hash_string(sp, h);
+    if (ret)
+	return ret;
+    if (!krb5_storage_is_flags(sp, KRB5_STORAGE_PRINCIPAL_NO_NAME_TYPE)) {
+	ret = krb5_ret_int32(sp, &tmp32);
+	if (ret)
+	    return ret;
+	if (tmp32 == KRB5_NT_SRV_HST_NEEDS_CANON)
+	    *needs_canon = 1;
+    }
+    return 0;
+}
+
+static int
+fkt_index_cmp(const void *a, const void *b)
+{
+    const struct fkt_index_entry *ea = a, *eb = b;
+
+    if (ea->hash != eb->hash)
+	return ea->hash < eb->hash ? -1 : 1;
+    /* keep file order within a hash */
+    if (ea->offset != eb->offset)
+	return ea->offset < eb->offset ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Walk the entries like fkt_next_entry_int() does, but only record
+ * where they are.  Stop at the first entry that fails to parse, like
+ * a scan would.
+ */
+
+static krb5_error_code
+fkt_index_build(krb5_context context, int fd, int version,
+		const struct stat *st, struct fkt_index **out)
+{
+    struct fkt_index *idx;
+    struct fkt_index_entry *e;
+    krb5_error_code ret = 0;
+    krb5_storage *sp = NULL;
+    void *map = NULL;
+    size_t alloc = 0;
+    int32_t len, tmp32;
+    uint32_t utmp32;
+    int16_t keytype, keylen;
+    int8_t tmp8;
+    off_t pos, curpos;
+    uint32_t hash;
+    krb5_kvno vno;
+
+    *out = NULL;
+
+    idx = heim_alloc(sizeof(*idx), "fkt-index", fkt_index_free);
+    if (idx == NULL)
+	return krb5_enomem(context);
+    idx->dev = st->st_dev;
+    idx->ino = st->st_ino;
+    idx->size = st->st_size;
+    idx->mtime = st->st_mtime;
+
+#if defined(HAVE_MMAP) && !defined(NO_MMAP)
+    if (st->st_size > 0) {
+	map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+	    map = NULL;
+    }
+    if (map)
+	sp = krb5_storage_from_readonly_mem(map, st->st_size);
+    else
+#endif
+	sp = krb5_storage_from_fd_buffered(fd);
+    if (sp == NULL) {
+#if defined(HAVE_MMAP) && !defined(NO_MMAP)
+	if (map)
+	    munmap(map, st->st_size);
+#endif
+	heim_release(idx);
+	return krb5_enomem(context);
+    }
+    krb5_storage_set_eof_code(sp, KRB5_KT_END);
+    storage_set_flags(context, sp, version);
+
+    /* skip the pvno and version tag */
+    pos = krb5_storage_seek(sp, 2, SEEK_SET);
+    while (krb5_ret_int32(sp, &len) == 0) {
+	if (len < 0) {
+	    pos = krb5_storage_seek(sp, -len, SEEK_CUR);
+	    continue;
+	}
+	if (fkt_ret_hash_principal(sp, &hash, &idx->needs_canon) ||
+	    krb5_ret_uint32(sp, &utmp32) ||
+	    krb5_ret_int8(sp, &tmp8) ||
+	    krb5_ret_int16(sp, &keytype) ||
+	    krb5_ret_int16(sp, &keylen))
+	    break;
+	vno = tmp8;
+	/* the key itself is never read */
+	krb5_storage_seek(sp, keylen, SEEK_CUR);
+	curpos = krb5_storage_seek(sp, 0, SEEK_CUR);
+	if (curpos > pos + 4 + len)
+	    break;
+	if (len + 4 + pos - curpos >= 4) {
+	    if (krb5_ret_int32(sp, &tmp32) == 0 && tmp32 != 0)
+		vno = tmp32;
+	}
+
+	if (idx->len == alloc) {
+	    alloc = alloc ? alloc * 2 : 64;
+	    e = realloc(idx->val, alloc * sizeof(idx->val[0]));
+	    if (e == NULL) {
+		ret = krb5_enomem(context);
+		break;
+	    }
+	    idx->val = e;
+	}
+	e = &idx->val[idx->len++];
+	e->hash = hash;
+	e->vno = vno;
+	e->enctype = keytype;
+	e->offset = pos;
+
+	pos = krb5_storage_seek(sp, pos + 4 + len, SEEK_SET);
+    }
+
+    krb5_storage_free(sp);
+#if defined(HAVE_MMAP) && !defined(NO_MMAP)
+    if (map)
+	munmap(map, st->st_size);
+#endif
+
+    if (ret) {
+	heim_release(idx);
+	return ret;
+    }
+    if (idx->len)
+	qsort(idx->val, idx->len, sizeof(idx->val[0]), fkt_index_cmp);
+
+    *out = idx;
+    return 0;
+}
+
+static krb5_error_code
+fkt_index_get(krb5_context context, krb5_keytab id,
+	      krb5_kt_cursor *cursor, struct fkt_index **out)
+{
+    struct fkt_data *d = id->data;
+    struct fkt_index *idx = NULL;
+    krb5_error_code ret;
+    heim_string_t key;
+    struct stat st;
+
+    *out = NULL;
+
+    if (fstat(cursor->fd, &st) != 0)
+	return errno;
+
+    key = heim_string_create(d->filename);
+    if (key == NULL)
+	return krb5_enomem(context);
+
+    HEIMDAL_MUTEX_lock(&fkt_index_mutex);
+    if (fkt_indexes)
+	idx = heim_dict_copy_value(fkt_indexes, key);
+    HEIMDAL_MUTEX_unlock(&fkt_index_mutex);
+
+    if (idx && idx->dev == st.st_dev && idx->ino == st.st_ino &&
+	idx->size == st.st_size && idx->mtime == st.st_mtime) {
+	heim_release(key);
+	*out = idx;
+	return 0;
+    }
+    heim_release(idx);
+
+    ret = fkt_index_build(context, cursor->fd, id->version, &st, &idx);
+    if (ret) {
+	heim_release(key);
+	return ret;
+    }
+
+    if (st.st_mtime < time(NULL)) {
+	HEIMDAL_MUTEX_lock(&fkt_index_mutex);
+	if (fkt_indexes == NULL)
+	    fkt_indexes = heim_dict_create(11);
+	if (fkt_indexes)
+	    heim_dict_set_value(fkt_indexes, key, idx);
+	HEIMDAL_MUTEX_unlock(&fkt_index_mutex);
+    }
+    heim_release(key);
+
+    *out = idx;
+    return 0;
+}
+
+/*
+ * Same matching as the scan in krb5_kt_get_entry(), but only over the
+ * entries whose name hashes like `principal', in file order.
+ */
+
+static krb5_error_code KRB5_CALLCONV
+fkt_get(krb5_context context,
+	krb5_keytab id,
+	krb5_const_principal principal,
+	krb5_kvno kvno,
+	krb5_enctype enctype,
+	krb5_keytab_entry *entry)
+{
+    struct fkt_index *idx;
+    krb5_keytab_entry tmp;
+    krb5_kt_cursor cursor;
+    krb5_error_code ret;
+    size_t lo, hi, mid;
+    uint32_t hash;
+
+    /* wildcard and name canonicalization lookups are left to the scan */
+    if (principal == NULL ||
+	principal->name.name_type == KRB5_NT_SRV_HST_NEEDS_CANON)
+	return KRB5_PLUGIN_NO_HANDLE;
+
+    ret = fkt_start_seq_get_int(context, id, O_RDONLY | O_BINARY | O_CLOEXEC,
+				0, &cursor);
+    if (ret)
+	return KRB5_PLUGIN_NO_HANDLE;
+
+    ret = fkt_index_get(context, id, &cursor, &idx);
+    if (ret || idx->needs_canon) {
+	heim_release(idx);
+	fkt_end_seq_get(context, id, &cursor);
+	return KRB5_PLUGIN_NO_HANDLE;
+    }
+
+    hash = fkt_hash_principal(principal);
+
+    lo = 0;
+    hi = idx->len;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (idx->val[mid].hash < hash)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    entry->vno = 0;
+    for (; lo < idx->len && idx->val[lo].hash == hash; lo++) {
+	const struct fkt_index_entry *e = &idx->val[lo];
+
+	if (enctype && enctype != e->enctype)
+	    continue;
+	if (!(kvno == e->vno || (e->vno < 256 && kvno % 256 == e->vno)) &&
+	    !(kvno == 0 && e->vno > entry->vno))
+	    continue;
+
+	krb5_storage_seek(cursor.sp, e->offset, SEEK_SET);
+	if (fkt_next_entry_int(context, id, &tmp, &cursor, NULL, NULL))
+	    break;
+
+	if (krb5_kt_compare(context, &tmp, principal, 0, enctype)) {
+	    /* the file keytab might only store the lower 8 bits of
+	       the kvno, so only compare those bits */
+	    if (kvno == tmp.vno
+		|| (tmp.vno < 256 && kvno % 256 == tmp.vno)) {
+		if (entry->vno)
+		    krb5_kt_free_entry(context, entry);
+		ret = krb5_kt_copy_entry_contents(context, &tmp, entry);
+		krb5_kt_free_entry(context, &tmp);
+		heim_release(idx);
+		fkt_end_seq_get(context, id, &cursor);
+		return ret;
+	    } else if (kvno == 0 && tmp.vno > entry->vno) {
+		if (entry->vno)
+		    krb5_kt_free_entry(context, entry);
+		krb5_kt_copy_entry_contents(context, &tmp, entry);
+	    }
+	}
+	krb5_kt_free_entry(context, &tmp);
+    }
+    heim_release(idx);
+    fkt_end_seq_get(context, id, &cursor);
+
+    if (entry->vno == 0)
+	return _krb5_kt_principal_not_found(context, KRB5_KT_NOTFOUND,
+					    id, principal, enctype, kvno);
+    return 0;
+}
+
 static krb5_error_code KRB5_CALLCONV
 fkt_setup_keytab(krb5_context context,
 		 krb5_keytab id,
@@ -553,7 +967,7 @@ fkt_add_entry(krb5_context context,
 	    close(fd);
 	    return ret;
 	}
-	sp = krb5_storage_from_fd(fd);
+	sp = krb5_storage_from_fd_buffered(fd);
 	krb5_storage_set_eof_code(sp, KRB5_KT_END);
 	ret = fkt_setup_keytab(context, id, sp);
 	if(ret) {
@@ -570,7 +984,7 @@ fkt_add_entry(krb5_context context,
 	    close(fd);
 	    return ret;
 	}
-	sp = krb5_storage_from_fd(fd);
+	sp = krb5_storage_from_fd_buffered(fd);
 	krb5_storage_set_eof_code(sp, KRB5_KT_END);
 	ret = krb5_ret_int8(sp, &pvno);
 	if(ret) {
@@ -756,7 +1170,7 @@ const krb5_kt_ops krb5_fkt_ops = {
     fkt_get_name,
     fkt_close,
     fkt_destroy,
-    NULL, /* get */
+    fkt_get,
     fkt_start_seq_get,
     fkt_next_entry,
     fkt_end_seq_get,
@@ -772,7 +1186,7 @@ const krb5_kt_ops krb5_wrfkt_ops = {
     fkt_get_name,
     fkt_close,
     fkt_destroy,
-    NULL, /* get */
+    fkt_get,
     fkt_start_seq_get,
     fkt_next_entry,
     fkt_end_seq_get,
@@ -788,7 +1202,7 @@ const krb5_kt_ops krb5_javakt_ops = {
     fkt_get_name,
     fkt_close,
     fkt_destroy,
-    NULL, /* get */
+    fkt_get,
     fkt_start_seq_get,
     fkt_next_entry,
     fkt_end_seq_get,
@@ -173,6 +173,7 @@ struct krb5_dh_moduli;
 
 /* v4 glue */
 struct _krb5_krb_auth_data;
+struct krb5_config_index;
 
 #include <der.h>
 
@@ -266,6 +267,8 @@ typedef struct krb5_context_data {
     int32_t kdc_sec_offset;
     int32_t kdc_usec_offset;
     krb5_config_section *cf;
+    heim_object_t cf_snapshot;		/* shared owner of cf, if any */
+    struct krb5_config_index *cf_index;	/* lookup index over cf */
     struct et_list *et_list;
     struct krb5_log_facility *warn_dest;
     struct krb5_log_facility *debug_dest;
@@ -308,6 +311,9 @@ typedef struct krb5_context_data {
     hx509_context hx509ctx;
 #endif
     unsigned int num_kdc_requests;
+    int kdc_conn_cache_size;		/* max idle KDC connections kept */
+    time_t kdc_conn_cache_timeout;	/* idle time before closing them */
+    heim_array_t kdc_conn_cache;	/* protected by mutex */
 } krb5_context_data;
 
 #ifndef KRB5_USE_PATH_TOKENS
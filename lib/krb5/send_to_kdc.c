@@ -51,6 +51,15 @@
  *
  *  Total wait time shorter then (number of addresses * 3) + kdc_timeout seconds.
  *
+ * If [libdefaults] kdc_connection_cache_size is set, TCP connections
+ * that returned a complete reply are kept open on the krb5_context for
+ * kdc_connection_cache_timeout seconds and reused by the next request
+ * to the same address, saving a TCP handshake for each TGS request.
+ *
+ * krb5_sendto_context() sends one request and waits for the reply.
+ * krb5_sendto_context_start(), krb5_sendto_context_wait() and
+ * krb5_sendto_context_finish() allow several requests, each with its
+ * own sendto context, to be in flight at the same time.
  */
 
 static int
@@ -152,6 +161,16 @@ struct krb5_sendto_ctx_data {
     heim_array_t hosts;
     int stateflags;
 #define KRBHST_COMPLETED	1
+#define SENDTO_STARTED		2
+
+    /* request state, see krb5_sendto_context_start() */
+    char *realm;
+    krb5_krbhst_handle handle;
+    int hosttype;
+    int action;
+    int numreset;
+    krb5_error_code ret;
+    struct timeval wait_until;
 
     /* prexmit */
     krb5_sendto_prexmit prexmit_func;
@@ -174,8 +193,12 @@ dealloc_sendto_ctx(void *ptr)
     krb5_sendto_ctx ctx = (krb5_sendto_ctx)ptr;
     if (ctx->hostname)
 	free(ctx->hostname);
+    if (ctx->realm)
+	free(ctx->realm);
+    krb5_data_free(&ctx->response);
     heim_release(ctx->hosts);
     heim_release(ctx->krbhst);
+    heim_release(ctx->handle);
 }
 
 KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
@@ -306,6 +329,8 @@ struct host {
     time_t timeout;
     krb5_data data;
     unsigned int tid;
+    int cached;		/* fd came from the connection cache */
+    int reusable;	/* connection can go back to the cache */
 };
 
 static void
@@ -366,6 +391,183 @@ host_dead(krb5_context context, struct host *host, const char *msg)
     host->state = DEAD;
 }
 
+static rk_socket_t
+host_socket(krb5_context context, const struct addrinfo *a)
+{
+    rk_socket_t fd;
+
+    fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+    if (rk_IS_BAD_SOCKET(fd))
+	return rk_INVALID_SOCKET;
+    rk_cloexec(fd);
+
+#ifndef NO_LIMIT_FD_SETSIZE
+    if (fd >= FD_SETSIZE) {
+	_krb5_debug(context, 0, "fd too large for select");
+	rk_closesocket(fd);
+	return rk_INVALID_SOCKET;
+    }
+#endif
+    socket_set_nonblocking(fd, 1);
+
+    return fd;
+}
+
+/*
+ * A cached connection might have been closed by the KDC just as we
+ * used it; open a new connection to the same address instead of
+ * giving up on the host.
+ */
+
+static int
+host_reopen(krb5_context context, struct host *host)
+{
+    rk_socket_t fd;
+
+    if (!host->cached)
+	return 0;
+    host->cached = 0;
+
+    fd = host_socket(context, host->ai);
+    if (rk_IS_BAD_SOCKET(fd))
+	return 0;
+
+    debug_host(context, 5, host, "cached connection lost, reconnecting");
+
+    rk_closesocket(host->fd);
+    host->fd = fd;
+    krb5_data_free(&host->data);
+    host->state = CONNECT;
+    host->timeout = 0;
+
+    return 1;
+}
+
+/*
+ * KDC connection cache
+ */
+
+struct kdc_conn {
+    rk_socket_t fd;
+    time_t expire;
+    socklen_t addrlen;
+    struct sockaddr_storage addr;
+};
+
+static void
+deallocate_kdc_conn(void *ptr)
+{
+    struct kdc_conn *conn = ptr;
+    if (!rk_IS_BAD_SOCKET(conn->fd))
+	rk_closesocket(conn->fd);
+}
+
+/* called with context->mutex held */
+static void
+kdc_conn_expire(krb5_context context, time_t now)
+{
+    size_t n = heim_array_get_length(context->kdc_conn_cache);
+
+    while (n-- > 0) {
+	struct kdc_conn *conn = heim_array_get_value(context->kdc_conn_cache, n);
+	if (conn->expire < now)
+	    heim_array_delete_value(context->kdc_conn_cache, n);
+    }
+}
+
+/*
+ * An idle connection has nothing to read, a readable one is either
+ * closed by the KDC or out of sync.
+ */
+
+static int
+kdc_conn_idle(rk_socket_t fd)
+{
+    struct timeval tv;
+    fd_set rfds;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+
+    return select(fd + 1, &rfds, NULL, NULL, &tv) == 0;
+}
+
+static rk_socket_t
+kdc_conn_get(krb5_context context, const struct addrinfo *a)
+{
+    rk_socket_t fd = rk_INVALID_SOCKET;
+    size_t n;
+
+    if (context->kdc_conn_cache_size <= 0)
+	return rk_INVALID_SOCKET;
+
+    HEIMDAL_MUTEX_lock(context->mutex);
+    if (context->kdc_conn_cache) {
+	kdc_conn_expire(context, time(NULL));
+
+	/* most recently used connections are at the end */
+	n = heim_array_get_length(context->kdc_conn_cache);
+	while (n-- > 0) {
+	    struct kdc_conn *conn = heim_array_get_value(context->kdc_conn_cache, n);
+
+	    if (conn->addrlen != a->ai_addrlen ||
+		memcmp(&conn->addr, a->ai_addr, a->ai_addrlen) != 0)
+		continue;
+
+	    if (kdc_conn_idle(conn->fd)) {
+		fd = conn->fd;
+		conn->fd = rk_INVALID_SOCKET;
+	    }
+	    heim_array_delete_value(context->kdc_conn_cache, n);
+	    if (!rk_IS_BAD_SOCKET(fd))
+		break;
+	}
+    }
+    HEIMDAL_MUTEX_unlock(context->mutex);
+
+    return fd;
+}
+
+static void
+kdc_conn_put(krb5_context context, struct host *host)
+{
+    struct kdc_conn *conn;
+
+    if (context->kdc_conn_cache_size <= 0 ||
+	host->ai->ai_addrlen > sizeof(conn->addr))
+	return;
+
+    conn = heim_alloc(sizeof(*conn), "sendto-kdc-conn", deallocate_kdc_conn);
+    if (conn == NULL)
+	return;
+
+    debug_host(context, 5, host, "caching connection");
+
+    conn->fd = host->fd;
+    conn->expire = time(NULL) + context->kdc_conn_cache_timeout;
+    conn->addrlen = host->ai->ai_addrlen;
+    memcpy(&conn->addr, host->ai->ai_addr, host->ai->ai_addrlen);
+
+    host->fd = rk_INVALID_SOCKET;
+    host->state = DEAD;
+
+    HEIMDAL_MUTEX_lock(context->mutex);
+    if (context->kdc_conn_cache == NULL)
+	context->kdc_conn_cache = heim_array_create();
+    if (context->kdc_conn_cache) {
+	kdc_conn_expire(context, time(NULL));
+	while (heim_array_get_length(context->kdc_conn_cache) >=
+	       (size_t)context->kdc_conn_cache_size)
+	    heim_array_delete_value(context->kdc_conn_cache, 0);
+	heim_array_append_value(context->kdc_conn_cache, conn);
+    }
+    HEIMDAL_MUTEX_unlock(context->mutex);
+
+    heim_release(conn);
+}
+
 static krb5_error_code
 send_stream(krb5_context context, struct host *host)
 {
@@ -617,6 +819,9 @@ recv_tcp(krb5_context context, struct host *host, krb5_data *data)
     if (pktlen > host->data.length - 4)
 	return -1;
 
+    /* only keep the connection if nothing but the reply was read */
+    host->reusable = (pktlen == host->data.length - 4);
+
     memmove(host->data.data, ((uint8_t *)host->data.data) + 4, host->data.length - 4);
     host->data.length -= 4;
 
@@ -728,8 +933,10 @@ eval_host_state(krb5_context context,
 	} else if (ret == 0) {
 	    /* if recv_foo function returns 0, we have a complete reply */
 	    debug_host(context, 5, host, "host completed");
+	    if (host->reusable)
+		kdc_conn_put(context, host);
 	    return 1;
-	} else {
+	} else if (!host_reopen(context, host)) {
 	    host_dead(context, host, "host disconnected");
 	}
     }
@@ -745,7 +952,8 @@ eval_host_state(krb5_context context,
 	if (ret == -1) {
 	    /* not done yet */
 	} else if (ret) {
-	    host_dead(context, host, "host dead, write failed");
+	    if (!host_reopen(context, host))
+		host_dead(context, host, "host dead, write failed");
 	} else
 	    host->state = WAITING_REPLY;
     }
@@ -833,21 +1041,16 @@ submit_request(krb5_context context, krb5_sendto_ctx ctx, krb5_krbhst_info *hi)
     ctx->stats.num_hosts++;
 
     for (a = ai; a != NULL; a = a->ai_next) {
-	rk_socket_t fd;
-
-	fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+	rk_socket_t fd = rk_INVALID_SOCKET;
+	int cached;
+
+	if (hi->proto == KRB5_KRBHST_TCP)
+	    fd = kdc_conn_get(context, a);
+	cached = !rk_IS_BAD_SOCKET(fd);
+	if (!cached)
+	    fd = host_socket(context, a);
 	if (rk_IS_BAD_SOCKET(fd))
 	    continue;
-	rk_cloexec(fd);
-
-#ifndef NO_LIMIT_FD_SETSIZE
-	if (fd >= FD_SETSIZE) {
-	    _krb5_debug(context, 0, "fd too large for select");
-	    rk_closesocket(fd);
-	    continue;
-	}
-#endif
-	socket_set_nonblocking(fd, 1);
 
 	host = heim_alloc(sizeof(*host), "sendto-host", deallocate_host);
 	if (host == NULL) {
@@ -857,6 +1060,7 @@ submit_request(krb5_context context, krb5_sendto_ctx ctx, krb5_krbhst_info *hi)
 	host->hi = hi;
 	host->fd = fd;
 	host->ai = a;
+	host->cached = cached;
 	/* next version of stid */
 	host->tid = ctx->stid = (ctx->stid & 0xffff0000) | ((ctx->stid & 0xffff) + 1);
 
@@ -879,9 +1083,14 @@ submit_request(krb5_context context, krb5_sendto_ctx ctx, krb5_krbhst_info *hi)
 	host->tries = host->fun->ntries;
 
 	/*
-	 * Connect directly next host, wait a host_timeout for each next address
+	 * Use a cached connection right away, connect directly next
+	 * host, wait a host_timeout for each next address
 	 */
-	if (submitted_host == 0)
+	if (cached) {
+	    debug_host(context, 5, host, "using cached connection");
+	    host_connected(context, ctx, host);
+	    host_next_timeout(context, host);
+	} else if (submitted_host == 0)
 	    host_connect(context, ctx, host);
 	else {
 	    debug_host(context, 5, host,
@@ -913,6 +1122,7 @@ struct wait_ctx {
     fd_set wfds;
     unsigned max_fd;
     int got_reply;
+    int activity;
     time_t timenow;
 };
 
@@ -986,6 +1196,9 @@ wait_process(heim_object_t obj, void *ctx, int *stop)
     readable = FD_ISSET(h->fd, &wait_ctx->rfds);
     writeable = FD_ISSET(h->fd, &wait_ctx->wfds);
 
+    if (readable || writeable)
+	wait_ctx->activity = 1;
+
     if (readable || writeable || h->state == CONNECT)
 	wait_ctx->got_reply |= eval_host_state(wait_ctx->context, wait_ctx->ctx, h, readable, writeable);
 
@@ -994,62 +1207,130 @@ wait_process(heim_object_t obj, void *ctx, int *stop)
 	*stop = 1;
 }
 
-static krb5_error_code
-wait_response(krb5_context context, int *action, krb5_sendto_ctx ctx)
+#define SENDTO_WAITING(ctx) \
+    (((ctx)->stateflags & SENDTO_STARTED) && (ctx)->action == KRB5_SENDTO_CONTINUE)
+
+/*
+ * Wait for all requests in `ctxs' that are waiting for replies, and
+ * move them to their next state.  A request that saw no network
+ * activity for a second moves on to the next KDC.
+ */
+
+static void
+wait_response(krb5_context context, krb5_sendto_ctx *ctxs, size_t num)
 {
     struct wait_ctx wait_ctx;
-    struct timeval tv;
+    struct timeval tv, now, left;
+    krb5_sendto_ctx ctx;
+    size_t i, nwait = 0;
     int ret;
 
     wait_ctx.context = context;
-    wait_ctx.ctx = ctx;
     FD_ZERO(&wait_ctx.rfds);
     FD_ZERO(&wait_ctx.wfds);
     wait_ctx.max_fd = 0;
 
-    /* oh, we have a reply, it must be a plugin that got it for us */
-    if (ctx->response.length) {
-	*action = KRB5_SENDTO_FILTER;
-	return 0;
-    }
+    gettimeofday(&now, NULL);
+    wait_ctx.timenow = now.tv_sec;
 
-    wait_ctx.timenow = time(NULL);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
 
-    heim_array_iterate_f(ctx->hosts, &wait_ctx, wait_setup);
-    heim_array_filter_f(ctx->hosts, &wait_ctx, wait_filter_dead);
+    for (i = 0; i < num; i++) {
+	ctx = ctxs[i];
+	if (ctx == NULL || !SENDTO_WAITING(ctx))
+	    continue;
 
-    if (heim_array_get_length(ctx->hosts) == 0) {
-	if (ctx->stateflags & KRBHST_COMPLETED) {
-	    _krb5_debug(context, 5, "no more hosts to send/recv packets to/from "
-			 "trying to pulling more hosts");
-	    *action = KRB5_SENDTO_FAILED;
-	} else {
-	    _krb5_debug(context, 5, "no more hosts to send/recv packets to/from "
-			 "and no more hosts -> failure");
-	    *action = KRB5_SENDTO_TIMEOUT;
+	/* oh, we have a reply, it must be a plugin that got it for us */
+	if (ctx->response.length) {
+	    ctx->action = KRB5_SENDTO_FILTER;
+	    continue;
 	}
-	return 0;
+
+	wait_ctx.ctx = ctx;
+	heim_array_iterate_f(ctx->hosts, &wait_ctx, wait_setup);
+	heim_array_filter_f(ctx->hosts, &wait_ctx, wait_filter_dead);
+
+	if (heim_array_get_length(ctx->hosts) == 0) {
+	    if (ctx->stateflags & KRBHST_COMPLETED) {
+		_krb5_debug(context, 5, "no more hosts to send/recv packets to/from "
+			    "trying to pulling more hosts");
+		ctx->action = KRB5_SENDTO_FAILED;
+	    } else {
+		_krb5_debug(context, 5, "no more hosts to send/recv packets to/from "
+			    "and no more hosts -> failure");
+		ctx->action = KRB5_SENDTO_TIMEOUT;
+	    }
+	    continue;
+	}
+
+	if (ctx->wait_until.tv_sec == 0) {
+	    ctx->wait_until = now;
+	    ctx->wait_until.tv_sec += 1;
+	}
+	left = ctx->wait_until;
+	timevalsub(&left, &now);
+	if (left.tv_sec < 0)
+	    left.tv_sec = left.tv_usec = 0;
+	if (left.tv_sec < tv.tv_sec ||
+	    (left.tv_sec == tv.tv_sec && left.tv_usec < tv.tv_usec))
+	    tv = left;
+
+	nwait++;
     }
 
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+    if (nwait == 0)
+	return;
+
+    /* don't block if some other request can make progress */
+    for (i = 0; i < num; i++) {
+	ctx = ctxs[i];
+	if (ctx && (ctx->stateflags & SENDTO_STARTED) &&
+	    ctx->action != KRB5_SENDTO_CONTINUE) {
+	    tv.tv_sec = tv.tv_usec = 0;
+	    break;
+	}
+    }
 
     ret = select(wait_ctx.max_fd + 1, &wait_ctx.rfds, &wait_ctx.wfds, NULL, &tv);
-    if (ret < 0)
-	return errno;
-    if (ret == 0) {
-	*action = KRB5_SENDTO_TIMEOUT;
-	return 0;
+    if (ret < 0) {
+	ret = errno;
+	for (i = 0; i < num; i++) {
+	    ctx = ctxs[i];
+	    if (ctx == NULL || !SENDTO_WAITING(ctx))
+		continue;
+	    ctx->ret = ret;
+	    ctx->action = KRB5_SENDTO_FAILED;
+	}
+	return;
     }
 
-    wait_ctx.got_reply = 0;
-    heim_array_iterate_f(ctx->hosts, &wait_ctx, wait_process);
-    if (wait_ctx.got_reply)
-	*action = KRB5_SENDTO_FILTER;
-    else
-	*action = KRB5_SENDTO_CONTINUE;
+    gettimeofday(&now, NULL);
+    wait_ctx.timenow = now.tv_sec;
 
-    return 0;
+    for (i = 0; i < num; i++) {
+	ctx = ctxs[i];
+	if (ctx == NULL || !SENDTO_WAITING(ctx))
+	    continue;
+
+	wait_ctx.ctx = ctx;
+	wait_ctx.got_reply = 0;
+	wait_ctx.activity = 0;
+	heim_array_iterate_f(ctx->hosts, &wait_ctx, wait_process);
+
+	if (wait_ctx.got_reply) {
+	    ctx->action = KRB5_SENDTO_FILTER;
+	    ctx->wait_until.tv_sec = ctx->wait_until.tv_usec = 0;
+	} else if (wait_ctx.activity) {
+	    ctx->wait_until = now;
+	    ctx->wait_until.tv_sec += 1;
+	} else if (now.tv_sec > ctx->wait_until.tv_sec ||
+		   (now.tv_sec == ctx->wait_until.tv_sec &&
+		    now.tv_usec >= ctx->wait_until.tv_usec)) {
+	    ctx->action = KRB5_SENDTO_TIMEOUT;
+	    ctx->wait_until.tv_sec = ctx->wait_until.tv_usec = 0;
+	}
+    }
 }
 
 static void
@@ -1058,89 +1339,53 @@ reset_context(krb5_context context, krb5_sendto_ctx ctx)
     krb5_data_free(&ctx->response);
     heim_release(ctx->hosts);
     ctx->hosts = heim_array_create();
-    ctx->stateflags = 0;
+    ctx->stateflags &= ~KRBHST_COMPLETED;
+    ctx->wait_until.tv_sec = ctx->wait_until.tv_usec = 0;
 }
 
-
 /*
- *
+ * Run the state machine of the request in `ctx' until it has to wait
+ * for replies or is done.
  */
 
-KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
-krb5_sendto_context(krb5_context context,
-		    krb5_sendto_ctx ctx,
-		    const krb5_data *send_data,
-		    krb5_const_realm realm,
-		    krb5_data *receive)
+static void
+sendto_run(krb5_context context, krb5_sendto_ctx ctx)
 {
-    krb5_error_code ret = 0;
-    krb5_krbhst_handle handle = NULL;
-    struct timeval nrstart, nrstop, stop_time;
-    int type, freectx = 0;
-    int action;
-    int numreset = 0;
-
-    krb5_data_zero(receive);
-    
-    if (ctx == NULL) {
-	ret = krb5_sendto_ctx_alloc(context, &ctx);
-	if (ret)
-	    goto out;
-	freectx = 1;
-    }
-
-    ctx->stid = (context->num_kdc_requests++) << 16;
-
-    memset(&ctx->stats, 0, sizeof(ctx->stats));
-    gettimeofday(&ctx->stats.start_time, NULL);
-
-    type = ctx->type;
-    if (type == 0) {
-	if ((ctx->flags & KRB5_KRBHST_FLAGS_MASTER) || context->use_admin_kdc)
-	    type = KRB5_KRBHST_ADMIN;
-	else
-	    type = KRB5_KRBHST_KDC;
-    }
-
-    ctx->send_data = send_data;
-
-    if ((int)send_data->length > context->large_msg_size)
-	ctx->flags |= KRB5_KRBHST_FLAGS_LARGE_MSG;
-
-    /* loop until we get back a appropriate response */
-
-    action = KRB5_SENDTO_INITIAL;
+    struct timeval nrstart, nrstop;
+    krb5_krbhst_info *hi;
+    krb5_error_code ret;
 
-    while (action != KRB5_SENDTO_DONE && action != KRB5_SENDTO_FAILED) {
-	krb5_krbhst_info *hi;
+    while (ctx->action != KRB5_SENDTO_DONE &&
+	   ctx->action != KRB5_SENDTO_FAILED &&
+	   ctx->action != KRB5_SENDTO_CONTINUE) {
 
-	switch (action) {
+	switch (ctx->action) {
 	case KRB5_SENDTO_INITIAL:
-	    ret = realm_via_plugin(context, realm, context->kdc_timeout,
-				   send_data, &ctx->response);
+	    ret = realm_via_plugin(context, ctx->realm, context->kdc_timeout,
+				   ctx->send_data, &ctx->response);
 	    if (ret == 0 || ret != KRB5_PLUGIN_NO_HANDLE) {
-		action = KRB5_SENDTO_DONE;
+		ctx->ret = ret;
+		ctx->action = KRB5_SENDTO_DONE;
 		break;
 	    }
-	    action = KRB5_SENDTO_KRBHST;
+	    ctx->action = KRB5_SENDTO_KRBHST;
 	    /* FALLTHOUGH */
 	case KRB5_SENDTO_KRBHST:
 	    if (ctx->krbhst == NULL) {
-		ret = krb5_krbhst_init_flags(context, realm, type,
-					     ctx->flags, &handle);
-		if (ret)
-		    goto out;
-
-		if (ctx->hostname) {
-		    ret = krb5_krbhst_set_hostname(context, handle, ctx->hostname);
-		    if (ret)
-			goto out;
+		ret = krb5_krbhst_init_flags(context, ctx->realm, ctx->hosttype,
+					     ctx->flags, &ctx->handle);
+		if (ret == 0 && ctx->hostname)
+		    ret = krb5_krbhst_set_hostname(context, ctx->handle,
+						   ctx->hostname);
+		if (ret) {
+		    ctx->ret = ret;
+		    ctx->action = KRB5_SENDTO_FAILED;
+		    break;
 		}
-
 	    } else {
-		handle = heim_retain(ctx->krbhst);
+		ctx->handle = heim_retain(ctx->krbhst);
 	    }
-	    action = KRB5_SENDTO_TIMEOUT;
+	    ctx->action = KRB5_SENDTO_TIMEOUT;
 	    /* FALLTHOUGH */
 	case KRB5_SENDTO_TIMEOUT:
 
@@ -1149,7 +1394,7 @@ krb5_sendto_context(krb5_context context,
 	     */
 
 	    if (ctx->stateflags & KRBHST_COMPLETED) {
-		action = KRB5_SENDTO_CONTINUE;
+		ctx->action = KRB5_SENDTO_CONTINUE;
 		break;
 	    }
 
@@ -1163,73 +1408,220 @@ krb5_sendto_context(krb5_context context,
 
 	    gettimeofday(&nrstart, NULL);
 
-	    ret = krb5_krbhst_next(context, handle, &hi);
+	    ret = krb5_krbhst_next(context, ctx->handle, &hi);
 
 	    gettimeofday(&nrstop, NULL);
 	    timevalsub(&nrstop, &nrstart);
 	    timevaladd(&ctx->stats.krbhst, &nrstop);
 
-	    action = KRB5_SENDTO_CONTINUE;
+	    ctx->action = KRB5_SENDTO_CONTINUE;
 	    if (ret == 0) {
 		_krb5_debug(context, 5, "submissing new requests to new host");
 		if (submit_request(context, ctx, hi) != 0)
-		    action = KRB5_SENDTO_TIMEOUT;
+		    ctx->action = KRB5_SENDTO_TIMEOUT;
 	    } else {
 		_krb5_debug(context, 5, "out of hosts, waiting for replies");
 		ctx->stateflags |= KRBHST_COMPLETED;
 	    }
 
-	    break;
-	case KRB5_SENDTO_CONTINUE:
-
-	    ret = wait_response(context, &action, ctx);
-	    if (ret)
-		goto out;
-
 	    break;
 	case KRB5_SENDTO_RESET:
 	    /* start over */
 	    _krb5_debug(context, 5,
 			"krb5_sendto trying over again (reset): %d",
-			numreset);
+			ctx->numreset);
 	    reset_context(context, ctx);
-	    if (handle) {
-		krb5_krbhst_free(context, handle);
-		handle = NULL;
+	    if (ctx->handle) {
+		krb5_krbhst_free(context, ctx->handle);
+		ctx->handle = NULL;
 	    }
-	    numreset++;
-	    if (numreset >= 3)
-		action = KRB5_SENDTO_FAILED;
+	    ctx->numreset++;
+	    if (ctx->numreset >= 3)
+		ctx->action = KRB5_SENDTO_FAILED;
 	    else
-		action = KRB5_SENDTO_KRBHST;
+		ctx->action = KRB5_SENDTO_KRBHST;
 
 	    break;
 	case KRB5_SENDTO_FILTER:
 	    /* default to next state, the filter function might modify this */
-	    action = KRB5_SENDTO_DONE;
+	    ctx->action = KRB5_SENDTO_DONE;
 
 	    if (ctx->func) {
 		ret = (*ctx->func)(context, ctx, ctx->data,
-				   &ctx->response, &action);
-		if (ret)
-		    goto out;
+				   &ctx->response, &ctx->action);
+		if (ret) {
+		    ctx->ret = ret;
+		    ctx->action = KRB5_SENDTO_FAILED;
+		    break;
+		}
+		/* drop the rejected reply so we don't filter it again */
+		if (ctx->action == KRB5_SENDTO_CONTINUE)
+		    krb5_data_free(&ctx->response);
 	    }
 	    break;
-	case KRB5_SENDTO_FAILED:
-	    ret = KRB5_KDC_UNREACH;
-	    break;
-	case KRB5_SENDTO_DONE:
-	    ret = 0;
-	    break;
 	default:
 	    heim_abort("invalid krb5_sendto_context state");
 	}
     }
+}
+
+/**
+ * Start sending `send_data' to the KDCs of `realm' without waiting
+ * for the reply.
+ *
+ * Several requests, each using its own sendto context, can be in
+ * flight at the same time; use krb5_sendto_context_wait() to drive
+ * them and krb5_sendto_context_finish() to collect each reply.
+ * `send_data' must stay valid until krb5_sendto_context_finish() is
+ * called.
+ *
+ * @param context Kerberos 5 context
+ * @param ctx sendto context, not already used by a started request
+ * @param send_data the request to send
+ * @param realm the realm of the KDCs to send the request to
+ *
+ * @return Return an error code or 0, see krb5_get_error_message().
+ *
+ * @ingroup krb5
+ */
+
+KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
+krb5_sendto_context_start(krb5_context context,
+			  krb5_sendto_ctx ctx,
+			  const krb5_data *send_data,
+			  krb5_const_realm realm)
+{
+    if (ctx->stateflags & SENDTO_STARTED) {
+	krb5_set_error_message(context, EINVAL,
+			       N_("sendto context already has a request "
+				  "in progress", ""));
+	return EINVAL;
+    }
+
+    ctx->realm = strdup(realm);
+    if (ctx->realm == NULL)
+	return krb5_enomem(context);
+
+    ctx->stid = (context->num_kdc_requests++) << 16;
+
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    gettimeofday(&ctx->stats.start_time, NULL);
+
+    ctx->hosttype = ctx->type;
+    if (ctx->hosttype == 0) {
+	if ((ctx->flags & KRB5_KRBHST_FLAGS_MASTER) || context->use_admin_kdc)
+	    ctx->hosttype = KRB5_KRBHST_ADMIN;
+	else
+	    ctx->hosttype = KRB5_KRBHST_KDC;
+    }
+
+    ctx->send_data = send_data;
+
+    if ((int)send_data->length > context->large_msg_size)
+	ctx->flags |= KRB5_KRBHST_FLAGS_LARGE_MSG;
+
+    ctx->stateflags |= SENDTO_STARTED;
+    ctx->action = KRB5_SENDTO_INITIAL;
+    ctx->numreset = 0;
+    ctx->ret = 0;
+
+    /* get the request out to the first KDC */
+    sendto_run(context, ctx);
+
+    return 0;
+}
+
+/**
+ * Wait until one of the requests started on `ctxs' with
+ * krb5_sendto_context_start() is done.  Contexts without a started
+ * request, and NULL entries, are ignored.
+ *
+ * The done request stays done until krb5_sendto_context_finish() is
+ * called on it, so that must be done before waiting again.
+ *
+ * @param context Kerberos 5 context
+ * @param ctxs array of sendto contexts
+ * @param num number of entries in ctxs
+ * @param idx the index in ctxs of the request that is done
+ *
+ * @return Return an error code or 0, see krb5_get_error_message().
+ * EINVAL is returned if no request is in progress.
+ *
+ * @ingroup krb5
+ */
+
+KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
+krb5_sendto_context_wait(krb5_context context,
+			 krb5_sendto_ctx *ctxs,
+			 size_t num,
+			 size_t *idx)
+{
+    size_t i, active;
+
+    while (1) {
+	active = 0;
+	for (i = 0; i < num; i++) {
+	    krb5_sendto_ctx ctx = ctxs[i];
+
+	    if (ctx == NULL || (ctx->stateflags & SENDTO_STARTED) == 0)
+		continue;
+
+	    sendto_run(context, ctx);
+	    if (ctx->action == KRB5_SENDTO_DONE ||
+		ctx->action == KRB5_SENDTO_FAILED) {
+		*idx = i;
+		return 0;
+	    }
+	    active++;
+	}
+	if (active == 0) {
+	    krb5_set_error_message(context, EINVAL,
+				   N_("no KDC request in progress", ""));
+	    return EINVAL;
+	}
+
+	wait_response(context, ctxs, num);
+    }
+}
+
+/**
+ * Complete the request started on `ctx' with
+ * krb5_sendto_context_start(), waiting for it if needed.  The sendto
+ * context can be used for a new request afterwards.
+ *
+ * @param context Kerberos 5 context
+ * @param ctx sendto context
+ * @param receive the reply from the KDC, free with krb5_data_free()
+ *
+ * @return Return an error code or 0, see krb5_get_error_message().
+ *
+ * @ingroup krb5
+ */
+
+KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
+krb5_sendto_context_finish(krb5_context context,
+			   krb5_sendto_ctx ctx,
+			   krb5_data *receive)
+{
+    struct timeval stop_time;
+    krb5_error_code ret;
+    size_t idx;
+
+    krb5_data_zero(receive);
+
+    if ((ctx->stateflags & SENDTO_STARTED) == 0) {
+	krb5_set_error_message(context, EINVAL,
+			       N_("no KDC request in progress", ""));
+	return EINVAL;
+    }
+
+    ret = krb5_sendto_context_wait(context, &ctx, 1, &idx);
+    if (ret == 0)
+	ret = ctx->ret;
 
     gettimeofday(&stop_time, NULL);
     timevalsub(&stop_time, &ctx->stats.start_time);
 
- out:
     if (ret == 0 && ctx->response.length) {
 	*receive = ctx->response;
 	krb5_data_zero(&ctx->response);
@@ -1239,25 +1631,59 @@ krb5_sendto_context(krb5_context context,
 	ret = KRB5_KDC_UNREACH;
 	krb5_set_error_message(context, ret,
 			       N_("unable to reach any KDC in realm %s", ""),
-			       realm);
+			       ctx->realm);
     }
 
     _krb5_debug(context, 1,
 		"krb5_sendto_context %s done: %d hosts %lu packets %lu wc: %ld.%06ld nr: %ld.%06ld kh: %ld.%06ld tid: %08x",
-		realm, ret,
+		ctx->realm, ret,
 		ctx->stats.num_hosts, ctx->stats.sent_packets,
 		stop_time.tv_sec, (long)stop_time.tv_usec,
 		ctx->stats.name_resolution.tv_sec, (long)ctx->stats.name_resolution.tv_usec,
 		ctx->stats.krbhst.tv_sec, (long)ctx->stats.krbhst.tv_usec, ctx->stid);
 
+    reset_context(context, ctx);
+    if (ctx->handle) {
+	krb5_krbhst_free(context, ctx->handle);
+	ctx->handle = NULL;
+    }
+    free(ctx->realm);
+    ctx->realm = NULL;
+    ctx->send_data = NULL;
+    ctx->stateflags = 0;
+
+    return ret;
+}
+
+/*
+ *
+ */
+
+KRB5_LIB_FUNCTION krb5_error_code KRB5_LIB_CALL
+krb5_sendto_context(krb5_context context,
+		    krb5_sendto_ctx ctx,
+		    const krb5_data *send_data,
+		    krb5_const_realm realm,
+		    krb5_data *receive)
+{
+    krb5_error_code ret;
+    int freectx = 0;
+
+    krb5_data_zero(receive);
+
+    if (ctx == NULL) {
+	ret = krb5_sendto_ctx_alloc(context, &ctx);
+	if (ret)
+	    return ret;
+	freectx = 1;
+    }
+
+    ret = krb5_sendto_context_start(context, ctx, send_data, realm);
+    if (ret == 0)
+	ret = krb5_sendto_context_finish(context, ctx, receive);
 
     if (freectx)
 	krb5_sendto_ctx_free(context, ctx);
-    else
-	reset_context(context, ctx);
-
-    if (handle)
-	krb5_krbhst_free(context, handle);
 
     return ret;
 }
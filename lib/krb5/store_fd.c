@@ -114,22 +114,155 @@ fd_free(krb5_storage * sp)
     close(FD(sp));
 }
 
-/**
- *
- *
- * @return A krb5_storage on success, or NULL on out of memory error.
- *
- * @ingroup krb5_storage
+/*
+ * Buffered variant: reads are served from a read-ahead buffer, writes
+ * go straight to the file after giving back any unread read-ahead, so
+ * write errors are still reported by the write itself.
  *
- * @sa krb5_storage_emem()
- * @sa krb5_storage_from_mem()
- * @sa krb5_storage_from_readonly_mem()
- * @sa krb5_storage_from_data()
- * @sa krb5_storage_from_socket()
+ * The logical position is bufstart + idx, the file offset is
+ * bufstart + len.  bufstart is -1 when the fd isn't seekable.
  */
 
-KRB5_LIB_FUNCTION krb5_storage * KRB5_LIB_CALL
-krb5_storage_from_fd(int fd_in)
+#define FD_BUF_SIZE 8192
+
+typedef struct fd_buf_storage {
+    int fd;			/* first, so FD() works */
+    off_t bufstart;
+    size_t len;
+    size_t idx;
+    unsigned char buf[FD_BUF_SIZE];
+} fd_buf_storage;
+
+#define FDB(S) ((fd_buf_storage*)(S)->data)
+
+/* make the file offset the logical position again */
+static int
+fd_buf_drop(krb5_storage *sp)
+{
+    fd_buf_storage *b = FDB(sp);
+
+    if (b->idx < b->len) {
+	if (b->bufstart < 0) {
+	    errno = ESPIPE;
+	    return -1;
+	}
+	if (lseek(b->fd, b->bufstart + b->idx, SEEK_SET) == (off_t)-1)
+	    return -1;
+    }
+    if (b->bufstart >= 0)
+	b->bufstart += b->idx;
+    b->len = b->idx = 0;
+    return 0;
+}
+
+static ssize_t
+fd_buf_fetch(krb5_storage * sp, void *data, size_t size)
+{
+    fd_buf_storage *b = FDB(sp);
+    unsigned char *cbuf = data;
+    size_t rem = size, n;
+    ssize_t count;
+
+    while (rem > 0) {
+	if (b->idx < b->len) {
+	    n = min(rem, b->len - b->idx);
+	    memcpy(cbuf, b->buf + b->idx, n);
+	    b->idx += n;
+	    cbuf += n;
+	    rem -= n;
+	    continue;
+	}
+
+	if (b->bufstart >= 0)
+	    b->bufstart += b->len;
+	b->len = b->idx = 0;
+
+	/* large reads bypass the buffer */
+	if (rem >= sizeof(b->buf))
+	    count = read(b->fd, cbuf, rem);
+	else
+	    count = read(b->fd, b->buf, sizeof(b->buf));
+	if (count < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return count;
+	} else if (count == 0) {
+	    return count;
+	}
+
+	if (rem >= sizeof(b->buf)) {
+	    if (b->bufstart >= 0)
+		b->bufstart += count;
+	    cbuf += count;
+	    rem -= count;
+	} else
+	    b->len = count;
+    }
+    return size;
+}
+
+static ssize_t
+fd_buf_store(krb5_storage * sp, const void *data, size_t size)
+{
+    fd_buf_storage *b = FDB(sp);
+    ssize_t count;
+
+    if (fd_buf_drop(sp) != 0)
+	return -1;
+
+    count = fd_store(sp, data, size);
+    if (count > 0 && b->bufstart >= 0)
+	b->bufstart += count;
+    return count;
+}
+
+static off_t
+fd_buf_seek(krb5_storage * sp, off_t offset, int whence)
+{
+    fd_buf_storage *b = FDB(sp);
+    off_t ret;
+
+    if (b->bufstart >= 0) {
+	if (whence == SEEK_CUR) {
+	    offset += b->bufstart + b->idx;
+	    whence = SEEK_SET;
+	}
+	/* stay within the buffer if we can */
+	if (whence == SEEK_SET && offset >= b->bufstart &&
+	    offset <= b->bufstart + (off_t)b->len) {
+	    b->idx = offset - b->bufstart;
+	    return offset;
+	}
+    } else if (whence == SEEK_CUR) {
+	offset -= (off_t)(b->len - b->idx);
+    }
+
+    ret = lseek(b->fd, offset, whence);
+    if (ret < 0)
+	return ret;
+    b->bufstart = ret;
+    b->len = b->idx = 0;
+    return ret;
+}
+
+static int
+fd_buf_trunc(krb5_storage * sp, off_t offset)
+{
+    if (fd_buf_drop(sp) != 0)
+	return errno;
+    return fd_trunc(sp, offset);
+}
+
+static void
+fd_buf_free(krb5_storage * sp)
+{
+    /* leave the shared file offset where the caller expects it */
+    (void)fd_buf_drop(sp);
+    fd_free(sp);
+}
+
+static krb5_storage *
+fd_storage_alloc(int fd_in, size_t size)
 {
     krb5_storage *sp;
     int saved_errno;
@@ -161,7 +294,7 @@ krb5_storage_from_fd(int fd_in)
     }
 
     errno = ENOMEM;
-    sp->data = malloc(sizeof(fd_storage));
+    sp->data = calloc(1, size);
     if (sp->data == NULL) {
 	saved_errno = errno;
 	close(fd);
@@ -181,3 +314,61 @@ krb5_storage_from_fd(int fd_in)
     sp->max_alloc = UINT_MAX/8;
     return sp;
 }
+
+/**
+ *
+ *
+ * @return A krb5_storage on success, or NULL on out of memory error.
+ *
+ * @ingroup krb5_storage
+ *
+ * @sa krb5_storage_emem()
+ * @sa krb5_storage_from_mem()
+ * @sa krb5_storage_from_readonly_mem()
+ * @sa krb5_storage_from_data()
+ * @sa krb5_storage_from_socket()
+ * @sa krb5_storage_from_fd_buffered()
+ */
+
+KRB5_LIB_FUNCTION krb5_storage * KRB5_LIB_CALL
+krb5_storage_from_fd(int fd_in)
+{
+    return fd_storage_alloc(fd_in, sizeof(fd_storage));
+}
+
+/**
+ * Like krb5_storage_from_fd(), but reads are buffered so that decoding
+ * a file doesn't cost a read() per field.  Writes are not buffered.
+ *
+ * The file offset of `fd_in' is undefined until the storage is freed,
+ * so the fd must not be read, written or seeked directly meanwhile;
+ * use krb5_storage_seek() to get the position.  On free the offset is
+ * set to the position of the storage, which requires a seekable fd if
+ * not all buffered data was consumed.
+ *
+ * @return A krb5_storage on success, or NULL on out of memory error.
+ *
+ * @ingroup krb5_storage
+ *
+ * @sa krb5_storage_from_fd()
+ */
+
+KRB5_LIB_FUNCTION krb5_storage * KRB5_LIB_CALL
+krb5_storage_from_fd_buffered(int fd_in)
+{
+    krb5_storage *sp;
+
+    sp = fd_storage_alloc(fd_in, sizeof(fd_buf_storage));
+    if (sp == NULL)
+	return NULL;
+
+    FDB(sp)->bufstart = lseek(FD(sp), 0, SEEK_CUR);
+    if (FDB(sp)->bufstart < 0)
+	FDB(sp)->bufstart = -1;
+    sp->fetch = fd_buf_fetch;
+    sp->store = fd_buf_store;
+    sp->seek = fd_buf_seek;
+    sp->trunc = fd_buf_trunc;
+    sp->free = fd_buf_free;
+    return sp;
+}
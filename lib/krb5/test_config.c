@@ -237,10 +237,85 @@ check_escaped_strings(void)
     krb5_free_context(context);
 }
 
+static void
+write_config(const char *fn, const char *realm)
+{
+    FILE *f;
+
+    f = fopen(fn, "w");
+    if (f == NULL)
+	err(1, "%s", fn);
+    fprintf(f, "[libdefaults]\n\tdefault_realm = %s\n", realm);
+    if (fclose(f) != 0)
+	err(1, "%s", fn);
+}
+
+static void
+check_realm(krb5_context context, const char *realm)
+{
+    const char *s;
+
+    s = krb5_config_get_string(context, NULL, "libdefaults",
+			       "default_realm", NULL);
+    if (s == NULL || strcmp(s, realm) != 0)
+	krb5_errx(context, 1, "default_realm is %s, expected %s",
+		  s ? s : "unset", realm);
+}
+
+/*
+ * Contexts made from the same unchanged files share one parsed
+ * configuration; after a file changes new contexts see the change
+ * while existing ones keep what they read.
+ */
+
+static void
+check_config_snapshot(void)
+{
+    const char *fn = "test_config_snapshot.conf";
+    krb5_context c1, c2, c3;
+    krb5_error_code ret;
+
+    write_config(fn, "ONE.EXAMPLE");
+    if (setenv("KRB5_CONFIG", fn, 1) != 0)
+	err(1, "setenv");
+
+    ret = krb5_init_context(&c1);
+    if (ret)
+	errx(1, "krb5_init_context %d", ret);
+    check_realm(c1, "ONE.EXAMPLE");
+
+    ret = krb5_init_context(&c2);
+    if (ret)
+	errx(1, "krb5_init_context %d", ret);
+    check_realm(c2, "ONE.EXAMPLE");
+#ifndef _WIN32
+    if (c1->cf != c2->cf)
+	krb5_errx(c2, 1, "unchanged configuration parsed again");
+#endif
+
+    /* A different size marks the file as changed within the same second */
+    write_config(fn, "TWO.EXAMPLE.ORG");
+
+    ret = krb5_init_context(&c3);
+    if (ret)
+	errx(1, "krb5_init_context %d", ret);
+    check_realm(c3, "TWO.EXAMPLE.ORG");
+    check_realm(c1, "ONE.EXAMPLE");
+    check_realm(c2, "ONE.EXAMPLE");
+
+    krb5_free_context(c1);
+    krb5_free_context(c2);
+    krb5_free_context(c3);
+
+    unsetenv("KRB5_CONFIG");
+    unlink(fn);
+}
+
 int
 main(int argc, char **argv)
 {
     check_config_files();
     check_escaped_strings();
+    check_config_snapshot();
     return 0;
 }
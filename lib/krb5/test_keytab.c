@@ -170,6 +170,108 @@ test_memory_keytab(krb5_context context, const char *keytab, const char *keytab2
     krb5_free_keyblock_contents(context, &entry3.keyblock);
 }
 
+/*
+ * Test that lookups in a FILE keytab pick the same entries as a scan
+ * of the keytab, also after it is modified.
+ */
+
+static void
+check_get_entry(krb5_context context, krb5_keytab id,
+		krb5_const_principal principal, krb5_kvno kvno,
+		krb5_enctype enctype, krb5_kvno expected)
+{
+    krb5_error_code ret;
+    krb5_keytab_entry entry;
+
+    ret = krb5_kt_get_entry(context, id, principal, kvno, enctype, &entry);
+    if (expected == 0) {
+	if (ret == 0)
+	    krb5_errx(context, 1, "krb5_kt_get_entry kvno %d enctype %d "
+		      "found kvno %d", (int)kvno, (int)enctype,
+		      (int)entry.vno);
+	return;
+    }
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_kt_get_entry kvno %d enctype %d",
+		 (int)kvno, (int)enctype);
+    if (entry.vno != expected)
+	krb5_errx(context, 1, "krb5_kt_get_entry kvno %d enctype %d "
+		  "found kvno %d, expected %d", (int)kvno, (int)enctype,
+		  (int)entry.vno, (int)expected);
+    if (!krb5_principal_compare(context, entry.principal, principal))
+	krb5_errx(context, 1, "krb5_kt_get_entry found wrong principal");
+    krb5_kt_free_entry(context, &entry);
+}
+
+static void
+test_file_keytab_get(krb5_context context, const char *keytab)
+{
+    krb5_error_code ret;
+    krb5_keytab id;
+    krb5_keytab_entry entry;
+    krb5_principal principal, other;
+    char name[64];
+    int i, kvno;
+
+    ret = krb5_kt_resolve(context, keytab, &id);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_kt_resolve");
+
+    for (i = 0; i < 100; i++) {
+	snprintf(name, sizeof(name), "host/h%d.su.se@SU.SE", i);
+	for (kvno = 1; kvno <= 3; kvno++) {
+	    memset(&entry, 0, sizeof(entry));
+	    ret = krb5_parse_name(context, name, &entry.principal);
+	    if (ret)
+		krb5_err(context, 1, ret, "krb5_parse_name");
+	    entry.vno = kvno;
+	    ret = krb5_generate_random_keyblock(context,
+						ETYPE_AES256_CTS_HMAC_SHA1_96,
+						&entry.keyblock);
+	    if (ret)
+		krb5_err(context, 1, ret, "krb5_generate_random_keyblock");
+	    ret = krb5_kt_add_entry(context, id, &entry);
+	    if (ret)
+		krb5_err(context, 1, ret, "krb5_kt_add_entry");
+	    krb5_kt_free_entry(context, &entry);
+	}
+    }
+
+    ret = krb5_parse_name(context, "host/h17.su.se@SU.SE", &principal);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_parse_name");
+    ret = krb5_parse_name(context, "host/h100.su.se@SU.SE", &other);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_parse_name");
+
+    check_get_entry(context, id, principal, 0, 0, 3);
+    check_get_entry(context, id, principal, 2, 0, 2);
+    check_get_entry(context, id, principal, 2,
+		    ETYPE_AES256_CTS_HMAC_SHA1_96, 2);
+    check_get_entry(context, id, principal, 2,
+		    ETYPE_AES128_CTS_HMAC_SHA1_96, 0);
+    check_get_entry(context, id, principal, 4, 0, 0);
+    check_get_entry(context, id, principal, 256 + 1, 0, 1);
+    check_get_entry(context, id, other, 0, 0, 0);
+
+    memset(&entry, 0, sizeof(entry));
+    entry.principal = principal;
+    entry.vno = 3;
+    ret = krb5_kt_remove_entry(context, id, &entry);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_kt_remove_entry");
+
+    check_get_entry(context, id, principal, 0, 0, 2);
+    check_get_entry(context, id, principal, 3, 0, 0);
+
+    krb5_free_principal(context, principal);
+    krb5_free_principal(context, other);
+
+    ret = krb5_kt_destroy(context, id);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_kt_destroy");
+}
+
 static void
 perf_add(krb5_context context, krb5_keytab id, int times)
 {
@@ -283,6 +385,8 @@ main(int argc, char **argv)
 
 	test_memory_keytab(context, "MEMORY:foo", "MEMORY:foo2");
 
+	test_file_keytab_get(context, "FILE:test-keytab-get");
+
     }
 
     krb5_free_context(context);
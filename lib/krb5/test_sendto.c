@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2026 Heimdal contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holders nor the names of their
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Get initial tickets for several requests at the same time with
+ * krb5_sendto_context_start()/wait()/finish(), a number of rounds,
+ * sleeping between the rounds so that the KDC gets to close the
+ * connections in the connection cache.
+ */
+
+#include "krb5_locl.h"
+#include <err.h>
+#include <getarg.h>
+
+static char *client_str = NULL;
+static char *password_str = NULL;
+static int count_int = 3;
+static int rounds_int = 2;
+static int sleep_int = 0;
+static int version_flag = 0;
+static int help_flag	= 0;
+
+static void
+start_request(krb5_context context,
+	      krb5_init_creds_context ctx,
+	      krb5_sendto_ctx stctx,
+	      krb5_data *in,
+	      krb5_data *out,
+	      krb5_const_realm realm,
+	      int *active)
+{
+    krb5_error_code ret;
+    unsigned int flags = 0;
+
+    ret = krb5_init_creds_step(context, ctx, in, out, NULL, &flags);
+    krb5_data_free(in);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_init_creds_step");
+
+    if ((flags & 1) == 0) {
+	*active = 0;
+	return;
+    }
+
+    ret = krb5_sendto_context_start(context, stctx, out, realm);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_sendto_context_start");
+    *active = 1;
+}
+
+static void
+test_round(krb5_context context, krb5_principal client)
+{
+    krb5_init_creds_context *ctx;
+    krb5_sendto_ctx *stctx;
+    krb5_data *out;
+    krb5_data in;
+    krb5_error_code ret;
+    krb5_creds cred;
+    int *active;
+    size_t i, idx, num = count_int, left;
+
+    ctx = ecalloc(num, sizeof(ctx[0]));
+    stctx = ecalloc(num, sizeof(stctx[0]));
+    out = ecalloc(num, sizeof(out[0]));
+    active = ecalloc(num, sizeof(active[0]));
+
+    for (i = 0; i < num; i++) {
+	ret = krb5_init_creds_init(context, client, NULL, NULL, 0, NULL,
+				   &ctx[i]);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_init_creds_init");
+
+	ret = krb5_init_creds_set_password(context, ctx[i], password_str);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_init_creds_set_password");
+
+	ret = krb5_sendto_ctx_alloc(context, &stctx[i]);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_sendto_ctx_alloc");
+
+	krb5_data_zero(&in);
+	start_request(context, ctx[i], stctx[i], &in, &out[i],
+		      client->realm, &active[i]);
+    }
+
+    for (left = num; left > 0; ) {
+	ret = krb5_sendto_context_wait(context, stctx, num, &idx);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_sendto_context_wait");
+
+	ret = krb5_sendto_context_finish(context, stctx[idx], &in);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_sendto_context_finish");
+
+	start_request(context, ctx[idx], stctx[idx], &in, &out[idx],
+		      client->realm, &active[idx]);
+	if (!active[idx])
+	    left--;
+    }
+
+    for (i = 0; i < num; i++) {
+	ret = krb5_init_creds_get_creds(context, ctx[i], &cred);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_init_creds_get_creds");
+	krb5_free_cred_contents(context, &cred);
+
+	krb5_init_creds_free(context, ctx[i]);
+	krb5_sendto_ctx_free(context, stctx[i]);
+    }
+
+    free(ctx);
+    free(stctx);
+    free(out);
+    free(active);
+}
+
+static struct getargs args[] = {
+    {"client",	0,	arg_string,	&client_str,
+     "client principal to use", NULL },
+    {"password",0,	arg_string,	&password_str,
+     "password", NULL },
+    {"count",	0,	arg_integer,	&count_int,
+     "number of requests at the same time", NULL },
+    {"rounds",	0,	arg_integer,	&rounds_int,
+     "number of rounds", NULL },
+    {"sleep",	0,	arg_integer,	&sleep_int,
+     "seconds to sleep between rounds", NULL },
+    {"version",	0,	arg_flag,	&version_flag,
+     "print version", NULL },
+    {"help",	0,	arg_flag,	&help_flag,
+     NULL, NULL }
+};
+
+static void
+usage (int ret)
+{
+    arg_printusage (args, sizeof(args)/sizeof(*args), NULL, "");
+    exit (ret);
+}
+
+int
+main(int argc, char **argv)
+{
+    krb5_context context;
+    krb5_error_code ret;
+    krb5_principal client;
+    int optidx = 0, i;
+
+    setprogname(argv[0]);
+
+    if(getarg(args, sizeof(args) / sizeof(args[0]), argc, argv, &optidx))
+	usage(1);
+
+    if (help_flag)
+	usage (0);
+
+    if(version_flag){
+	print_version(NULL);
+	exit(0);
+    }
+
+    if(client_str == NULL)
+	errx(1, "client is not set");
+    if(password_str == NULL)
+	errx(1, "password is not set");
+    if(count_int < 1 || rounds_int < 1)
+	errx(1, "count and rounds must be positive");
+
+    ret = krb5_init_context(&context);
+    if (ret)
+	errx (1, "krb5_init_context failed: %d", ret);
+
+    ret = krb5_parse_name(context, client_str, &client);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_parse_name: %d", ret);
+
+    for (i = 0; i < rounds_int; i++) {
+	if (i > 0 && sleep_int > 0)
+	    sleep(sleep_int);
+	test_round(context, client);
+    }
+
+    krb5_free_principal(context, client);
+    krb5_free_context(context);
+
+    return 0;
+}
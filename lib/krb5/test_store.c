@@ -217,6 +217,62 @@ test_truncate(krb5_context context, krb5_storage *sp, int fd)
 	krb5_errx(context, 1, "length not 2");
 }
 
+static void
+test_buffered(krb5_context context, krb5_storage *sp, int fd)
+{
+    krb5_error_code ret;
+    uint32_t idx[] = { 4999, 3000, 2047, 2048, 10, 0 };
+    uint32_t i, v, n = 5000;
+    off_t off;
+
+    krb5_storage_truncate(sp, 0);
+    krb5_storage_seek(sp, 0, SEEK_SET);
+    for (i = 0; i < n; i++) {
+	ret = krb5_store_uint32(sp, i);
+	if (ret)
+	    krb5_err(context, 1, ret, "krb5_store_uint32");
+    }
+
+    /* read into the read-ahead, then overwrite the next value */
+    krb5_storage_seek(sp, 0, SEEK_SET);
+    for (i = 0; i < 10; i++) {
+	ret = krb5_ret_uint32(sp, &v);
+	if (ret || v != i)
+	    krb5_errx(context, 1, "buffered read %u", (unsigned)i);
+    }
+    off = krb5_storage_seek(sp, 0, SEEK_CUR);
+    if (off != 40)
+	krb5_errx(context, 1, "buffered position %ld", (long)off);
+    ret = krb5_store_uint32(sp, 0xdeadbeef);
+    if (ret)
+	krb5_err(context, 1, ret, "krb5_store_uint32");
+    for (i = 11; i < n; i++) {
+	ret = krb5_ret_uint32(sp, &v);
+	if (ret || v != i)
+	    krb5_errx(context, 1, "buffered read after write %u", (unsigned)i);
+    }
+    ret = krb5_ret_uint32(sp, &v);
+    if (ret == 0)
+	krb5_errx(context, 1, "buffered read past end");
+
+    /* seek backwards across buffer boundaries */
+    for (i = 0; i < sizeof(idx)/sizeof(idx[0]); i++) {
+	krb5_storage_seek(sp, idx[i] * 4, SEEK_SET);
+	ret = krb5_ret_uint32(sp, &v);
+	if (ret || v != (idx[i] == 10 ? 0xdeadbeef : idx[i]))
+	    krb5_errx(context, 1, "buffered seek %u", (unsigned)idx[i]);
+    }
+
+    /* on free the shared offset is the storage position */
+    krb5_storage_seek(sp, 12, SEEK_SET);
+    ret = krb5_ret_uint32(sp, &v);
+    if (ret || v != 3)
+	krb5_errx(context, 1, "buffered read 3");
+    krb5_storage_free(sp);
+    if (lseek(fd, 0, SEEK_CUR) != 16)
+	krb5_errx(context, 1, "offset not restored on free");
+}
+
 static void
 check_too_large(krb5_context context, krb5_storage *sp)
 {
@@ -331,6 +387,24 @@ main(int argc, char **argv)
     close(fd);
     unlink(fn);
 
+    /*
+     * test buffered fd storage
+     */
+
+    fd = open(fn, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0)
+	krb5_err(context, 1, errno, "open(%s)", fn);
+
+    sp = krb5_storage_from_fd_buffered(fd);
+    if (sp == NULL)
+	krb5_errx(context, 1, "krb5_storage_from_fd_buffered: %s no mem", fn);
+
+    test_storage(context, sp);
+    test_truncate(context, sp, fd);
+    test_buffered(context, sp, fd);
+    close(fd);
+    unlink(fn);
+
     krb5_free_context(context);
 
     return 0;
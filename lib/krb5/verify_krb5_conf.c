@@ -556,7 +556,14 @@ struct entry kdc_entries[] = {
     { "enable-pkinit", krb5_config_string, check_boolean, 0 },
     { "encode_as_rep_as_tgs_rep", krb5_config_string, check_boolean, 0 },
     { "enforce-transited-policy", krb5_config_string, NULL, 1 },
+    { "hdb-bulk-batch-size", krb5_config_string, check_numeric, 0 },
+    { "hdb-ldap-cache-ttl", krb5_config_string, check_time, 0 },
     { "hdb-ldap-create-base", krb5_config_string, NULL, 0 },
+    { "hdb-ldap-keep-open", krb5_config_string, check_boolean, 0 },
+    { "hdb-mdb-keep-open", krb5_config_string, check_boolean, 0 },
+    { "hdb-sqlite-cache-size", krb5_config_string, check_bytes, 0 },
+    { "hdb-sqlite-journal-mode", krb5_config_string, NULL, 0 },
+    { "hdb-sqlite-mmap-size", krb5_config_string, check_bytes, 0 },
     { "iprop-acl", krb5_config_string, NULL, 0 },
     { "iprop-stats", krb5_config_string, NULL, 0 },
     { "kdc-request-log", krb5_config_string, NULL, 0 },
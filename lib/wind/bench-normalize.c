@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2026 Heimdal contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holders nor the names of their
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Times wind_stringprep() and _wind_stringprep_normalize() on ASCII
+ * and non-ASCII strings.  Not run by `make check'.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <sys/time.h>
+
+#include <roken.h>
+#include <getarg.h>
+
+#include "windlocl.h"
+
+static int iterations_int = 100000;
+static int version_flag = 0;
+static int help_flag	= 0;
+
+static const char *strings[] = {
+    "Administrator",
+    "CN=Hostmaster,OU=Services,O=Example Corporation,C=SE",
+    "Lindstr\xc3\xb6m",
+    "\xef\xbc\xb2\xef\xbd\x85\xef\xbd\x81\xef\xbd\x8c\xef\xbd\x8d",
+    "A\xcc\x8a" "ngstr\xc3\xb6m",
+};
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) +
+	(now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void
+bench(const char *s, unsigned long iterations)
+{
+    uint32_t in[128], out[128 * 4];
+    size_t in_len = sizeof(in)/sizeof(in[0]), out_len;
+    struct timeval start;
+    unsigned long i;
+    double t;
+
+    if (wind_utf8ucs4(s, in, &in_len))
+	errx(1, "wind_utf8ucs4: %s", s);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iterations; i++) {
+	out_len = sizeof(out)/sizeof(out[0]);
+	if (_wind_stringprep_normalize(in, in_len, out, &out_len))
+	    errx(1, "_wind_stringprep_normalize: %s", s);
+    }
+    t = elapsed(&start);
+    printf("%-56s normalize  %8.1f ns\n", s, t * 1e9 / iterations);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iterations; i++) {
+	out_len = sizeof(out)/sizeof(out[0]);
+	if (wind_stringprep(in, in_len, out, &out_len, WIND_PROFILE_LDAP))
+	    errx(1, "wind_stringprep: %s", s);
+    }
+    t = elapsed(&start);
+    printf("%-56s stringprep %8.1f ns\n", s, t * 1e9 / iterations);
+}
+
+static struct getargs args[] = {
+    {"iterations", 0,	arg_integer,	&iterations_int,
+     "number of iterations per string", NULL },
+    {"version",	0,	arg_flag,	&version_flag,
+     "print version", NULL },
+    {"help",	0,	arg_flag,	&help_flag,
+     NULL, NULL }
+};
+
+static void
+usage (int ret)
+{
+    arg_printusage(args, sizeof(args)/sizeof(args[0]), NULL, "");
+    exit (ret);
+}
+
+int
+main(int argc, char **argv)
+{
+    int optidx = 0;
+    size_t i;
+
+    setprogname (argv[0]);
+
+    if(getarg(args, sizeof(args) / sizeof(args[0]), argc, argv, &optidx))
+	usage(1);
+
+    if (help_flag)
+	usage (0);
+
+    if(version_flag){
+	print_version(NULL);
+	exit(0);
+    }
+
+    if (argc != optidx)
+	usage(1);
+    if (iterations_int <= 0)
+	errx(1, "bad iteration count");
+
+    for (i = 0; i < sizeof(strings)/sizeof(strings[0]); i++)
+	bench(strings[i], iterations_int);
+    return 0;
+}
@@ -40,6 +40,7 @@ import sys
 
 import generate
 import UnicodeData
+import util
 
 if len(sys.argv) != 3:
     print "usage: %s UnicodeData.txt out-dir" % sys.argv[0]
@@ -61,14 +62,9 @@ combining_h.file.write(
 '''
 #include <krb5-types.h>
 
-struct translation {
-  uint32_t key;
-  unsigned combining_class;	
-};
-
-extern const struct translation _wind_combining_table[];
-
-extern const size_t _wind_combining_table_size;
+/* canonical combining class of a code point */
+extern const unsigned short _wind_combining_page[];
+extern const unsigned char _wind_combining_class_table[];
 ''')
 
 combining_c.file.write(
@@ -76,29 +72,13 @@ combining_c.file.write(
 #include "combining_table.h"
 #include <stdlib.h>
 
-const struct translation _wind_combining_table[] = {
 ''')
 
-s = trans.keys()
-s.sort()
-for k in s:
-    v = trans[k]
-    combining_c.file.write("{0x%x, %u}, /* %s */\n"
-                           % (k, v[0], v[1]))
-    
-
-#trans.sort()
-#for x in trans:
-#    combining_c.file.write("{0x%x, %u}, /* %s */\n"
-#                           % (x[0], x[1], x[2]))
-
-combining_c.file.write(
-'''
-};
-''')
-
-combining_c.file.write(
-    "const size_t _wind_combining_table_size = %u;\n" % len(trans))
+(pages, blocks) = util.pageTable(dict([(k, v[0]) for k,v in trans.items()]), 0)
+util.writeArray(combining_c.file,
+                "const unsigned short _wind_combining_page", pages)
+util.writeArray(combining_c.file,
+                "const unsigned char _wind_combining_class_table", blocks)
 
 
 combining_h.close()
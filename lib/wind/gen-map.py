@@ -77,6 +77,10 @@ extern const size_t _wind_map_table_size;
 
 extern const uint32_t _wind_map_table_val[];
 
+/* index of a code point in _wind_map_table plus one, or 0 */
+extern const unsigned short _wind_map_page[];
+extern const unsigned short _wind_map_index[];
+
 ''')
 
 map_c.file.write(
@@ -145,6 +149,11 @@ map_c.file.write(
 map_c.file.write(
     "const size_t _wind_map_table_size = %u;\n\n" % len(trans))
 
+(pages, blocks) = util.pageTable(dict([(trans[i][0], i + 1)
+                                       for i in range(len(trans))]), 0)
+util.writeArray(map_c.file, "const unsigned short _wind_map_page", pages)
+util.writeArray(map_c.file, "const unsigned short _wind_map_index", blocks)
+
 map_c.file.write(
     "const uint32_t _wind_map_table_val[] = {\n")
 
@@ -83,6 +83,10 @@ extern const uint32_t _wind_normalize_val_table[];
 
 extern const size_t _wind_normalize_table_size;
 
+/* index of a code point in _wind_normalize_table plus one, or 0 */
+extern const unsigned short _wind_normalize_page[];
+extern const unsigned short _wind_normalize_index[];
+
 struct canon_node {
   uint32_t val;
   unsigned char next_start;
@@ -104,8 +108,10 @@ const struct translation _wind_normalize_table[] = {
 ''')
 
 normalizeValTable = []
+normalizeIndex = {}
 
 for k in sortedKeys(trans) :
+    normalizeIndex[k] = len(normalizeIndex) + 1
     v = trans[k]
     (key, value, description) = k, v[0], v[1]
     vec = [int(x, 0x10) for x in value.split()];
@@ -124,6 +130,12 @@ normalize_c.file.write(
 normalize_c.file.write(
     "const size_t _wind_normalize_table_size = %u;\n\n" % len(trans))
 
+(pages, blocks) = util.pageTable(normalizeIndex, 0)
+util.writeArray(normalize_c.file,
+                "const unsigned short _wind_normalize_page", pages)
+util.writeArray(normalize_c.file,
+                "const unsigned short _wind_normalize_index", blocks)
+
 normalize_c.file.write("const uint32_t _wind_normalize_val_table[] = {\n")
 
 for v in normalizeValTable:
@@ -40,13 +40,15 @@
 
 #include "map_table.h"
 
-static int
-translation_cmp(const void *key, const void *data)
+static const struct translation *
+map_lookup(uint32_t cp)
 {
-    const struct translation *t1 = (const struct translation *)key;
-    const struct translation *t2 = (const struct translation *)data;
+    unsigned short i;
 
-    return t1->key - t2->key;
+    if (cp >= 0x110000)
+	return NULL;
+    i = _wind_map_index[_wind_map_page[cp >> 8] * 256 + (cp & 0xff)];
+    return i ? &_wind_map_table[i - 1] : NULL;
 }
 
 int
@@ -58,13 +60,8 @@ _wind_stringprep_map(const uint32_t *in, size_t in_len,
     unsigned o = 0;
 
     for (i = 0; i < in_len; ++i) {
-	struct translation ts = {in[i], 0, 0, 0};
-	const struct translation *s;
+	const struct translation *s = map_lookup(in[i]);
 
-	s = (const struct translation *)
-	    bsearch(&ts, _wind_map_table, _wind_map_table_size,
-		    sizeof(_wind_map_table[0]),
-		    translation_cmp);
 	if (s != NULL && (s->flags & flags)) {
 	    unsigned j;
 
@@ -38,6 +38,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <stdio.h>
 
@@ -45,13 +46,15 @@
 
 #include "normalize_table.h"
 
-static int
-translation_cmp(const void *key, const void *data)
+static const struct translation *
+normalize_lookup(uint32_t cp)
 {
-    const struct translation *t1 = (const struct translation *)key;
-    const struct translation *t2 = (const struct translation *)data;
+    unsigned short i;
 
-    return t1->key - t2->key;
+    if (cp >= 0x110000)
+	return NULL;
+    i = _wind_normalize_index[_wind_normalize_page[cp >> 8] * 256 + (cp & 0xff)];
+    return i ? &_wind_normalize_table[i - 1] : NULL;
 }
 
 enum { s_base  = 0xAC00};
@@ -127,7 +130,6 @@ compat_decomp(const uint32_t *in, size_t in_len,
     unsigned o = 0;
 
     for (i = 0; i < in_len; ++i) {
-	struct translation ts = {in[i], 0, 0};
 	size_t sub_len = *out_len - o;
 	int ret;
 
@@ -138,14 +140,9 @@ compat_decomp(const uint32_t *in, size_t in_len,
 		return ret;
 	    o += sub_len;
 	} else {
-	    void *s = bsearch(&ts,
-			      _wind_normalize_table,
-			      _wind_normalize_table_size,
-			      sizeof(_wind_normalize_table[0]),
-			      translation_cmp);
-	    if (s != NULL) {
-		const struct translation *t = (const struct translation *)s;
+	    const struct translation *t = normalize_lookup(in[i]);
 
+	    if (t != NULL) {
 		ret = compat_decomp(_wind_normalize_val_table + t->val_offset,
 				    t->val_len,
 				    out + o, &sub_len);
@@ -297,7 +294,7 @@ int
 _wind_stringprep_normalize(const uint32_t *in, size_t in_len,
 			   uint32_t *out, size_t *out_len)
 {
-    size_t tmp_len;
+    size_t tmp_len, i;
     uint32_t *tmp;
     int ret;
 
@@ -306,6 +303,17 @@ _wind_stringprep_normalize(const uint32_t *in, size_t in_len,
 	return 0;
     }
 
+    /* ASCII neither decomposes nor combines */
+    for (i = 0; i < in_len && in[i] < 0x80; i++)
+	;
+    if (i == in_len) {
+	if (*out_len < in_len)
+	    return WIND_ERR_OVERRUN;
+	memmove(out, in, in_len * sizeof(in[0]));
+	*out_len = in_len;
+	return 0;
+    }
+
     tmp_len = in_len * 4;
     if (tmp_len < MAX_LENGTH_CANON)
 	tmp_len = MAX_LENGTH_CANON;
@@ -59,8 +59,8 @@ wind_stringprep(const uint32_t *in, size_t in_len,
 {
     size_t tmp_len = in_len * 3;
     uint32_t *tmp;
-    int ret;
-    size_t olen;
+    int ret, ascii;
+    size_t olen, i;
 
     if (in_len == 0) {
 	*out_len = 0;
@@ -77,6 +77,11 @@ wind_stringprep(const uint32_t *in, size_t in_len,
 	return ret;
     }
 
+    /* ASCII is already normalized and has no right-to-left characters */
+    for (i = 0; i < tmp_len && tmp[i] < 0x80; i++)
+	;
+    ascii = (i == tmp_len);
+
     olen = *out_len;
     ret = _wind_stringprep_normalize(tmp, tmp_len, tmp, &olen);
     if (ret) {
@@ -88,10 +93,12 @@ wind_stringprep(const uint32_t *in, size_t in_len,
 	free(tmp);
 	return ret;
     }
-    ret = _wind_stringprep_testbidi(tmp, olen, flags);
-    if (ret) {
-	free(tmp);
-	return ret;
+    if (!ascii) {
+	ret = _wind_stringprep_testbidi(tmp, olen, flags);
+	if (ret) {
+	    free(tmp);
+	    return ret;
+	}
     }
 
     /* Insignificant Character Handling for ldap-prep */
@@ -46,3 +46,26 @@ def subList(l, sl) :
             return i
     return None
 
+def pageTable(values, default):
+    """split a dict from code point to value into 256 entry pages
+
+    returns (pages, blocks): the value for code point c is
+    blocks[pages[c >> 8] * 256 + (c & 0xff)], identical pages share
+    a block"""
+    pages = []
+    blocks = []
+    blockIndex = {}
+    for p in range(0x110000 >> 8):
+        block = tuple([values.get((p << 8) + i, default) for i in range(256)])
+        if not blockIndex.has_key(block):
+            blockIndex[block] = len(blocks)
+            blocks.append(block)
+        pages.append(blockIndex[block])
+    return (pages, [x for b in blocks for x in b])
+
+def writeArray(f, decl, values):
+    """write a C array definition, 16 values per line"""
+    f.write("%s[] = {\n" % decl)
+    for i in range(0, len(values), 16):
+        f.write("  %s,\n" % ", ".join(["%u" % x for x in values[i:i+16]]))
+    f.write("};\n\n")